@@ -0,0 +1,173 @@
+#include "include/CopyTool/CopyEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    class CopyExecutor
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static CopyExecutor &Instance()
+        {
+            static CopyExecutor executor(std::max(2u, std::thread::hardware_concurrency()));
+            return executor;
+        }
+
+        static CopyExecutor &CompressionInstance()
+        {
+            static CopyExecutor executor(std::max(2u, std::thread::hardware_concurrency()));
+            return executor;
+        }
+
+        void Post(std::function<void()> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _tasks.push_back(std::move(task));
+            }
+            _conditionalVariable.notify_one();
+        }
+
+        // The task waits in a timer queue, not on a thread, until it is due.
+        void PostAt(Clock::time_point due, std::function<void()> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _delayedTasks.emplace(due, std::move(task));
+            }
+            _conditionalVariable.notify_all();
+        }
+
+        ~CopyExecutor()
+        {
+            for (auto &thread : _threads)
+            {
+                thread.request_stop();
+            }
+            _conditionalVariable.notify_all();
+        }
+
+    private:
+        explicit CopyExecutor(std::size_t threadCount)
+        {
+            _threads.reserve(threadCount);
+            for (std::size_t i = 0; i < threadCount; ++i)
+            {
+                _threads.emplace_back(&CopyExecutor::run, this);
+            }
+        }
+
+        void run(std::stop_token stopToken)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (!stopToken.stop_requested())
+            {
+                for (auto now = Clock::now(); !_delayedTasks.empty() && _delayedTasks.begin()->first <= now;)
+                {
+                    _tasks.push_back(std::move(_delayedTasks.begin()->second));
+                    _delayedTasks.erase(_delayedTasks.begin());
+                }
+                if (_tasks.empty())
+                {
+                    if (_delayedTasks.empty())
+                    {
+                        _conditionalVariable.wait(lock, stopToken, [this]()
+                                                  { return !_tasks.empty() || !_delayedTasks.empty(); });
+                    }
+                    else
+                    {
+                        // Woken early when a task is posted or a delayed task falls due before this one.
+                        auto due = _delayedTasks.begin()->first;
+                        _conditionalVariable.wait_until(lock, stopToken, due, [this, due]()
+                                                        { return !_tasks.empty() || _delayedTasks.empty() || _delayedTasks.begin()->first < due; });
+                    }
+                    continue;
+                }
+                auto task = std::move(_tasks.front());
+                _tasks.pop_front();
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+
+        std::mutex _mutex;
+        std::condition_variable_any _conditionalVariable;
+        std::deque<std::function<void()>> _tasks;
+        std::multimap<Clock::time_point, std::function<void()>> _delayedTasks;
+        std::vector<std::jthread> _threads;
+    };
+}
+
+void PostCopyTask(std::function<void()> task)
+{
+    CopyExecutor::Instance().Post(std::move(task));
+}
+
+void PostCopyTaskAfter(std::chrono::steady_clock::duration delay, std::function<void()> task)
+{
+    if (delay <= std::chrono::steady_clock::duration::zero())
+    {
+        CopyExecutor::Instance().Post(std::move(task));
+        return;
+    }
+    CopyExecutor::Instance().PostAt(std::chrono::steady_clock::now() + delay, std::move(task));
+}
+
+void PostCompressionTask(std::function<void()> task)
+{
+    CopyExecutor::CompressionInstance().Post(std::move(task));
+}
+
+std::future<void> ICopyTool::CopyFileAsync(const std::filesystem::path &source,
+                                           const std::filesystem::path &destination,
+                                           CopyProgressCallback progress,
+                                           std::stop_token stopToken)
+{
+    auto promise = std::promise<void>();
+    auto future = promise.get_future();
+    // CopyFile blocks for the whole copy, possibly waiting for a peer process, so it runs on a thread of
+    // its own instead of holding one of the executor threads the chunked copies share.
+    std::thread([this, promise = std::move(promise), source, destination, progress = std::move(progress),
+                 stopToken = std::move(stopToken)]() mutable
+                {
+        auto cancelled = [&source]()
+        {
+            return CopyCancelledError("Copying of " + source.generic_string() + " was cancelled");
+        };
+        try
+        {
+            if (stopToken.stop_requested())
+            {
+                throw cancelled();
+            }
+            CopyFile(source, destination);
+            // CopyFile cannot be interrupted, so a stop requested while it ran discards the copy afterwards.
+            if (stopToken.stop_requested())
+            {
+                std::filesystem::remove(destination);
+                throw cancelled();
+            }
+            if (progress)
+            {
+                auto size = std::filesystem::file_size(destination);
+                progress(CopyProgress{size, size});
+            }
+            promise.set_value();
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        } })
+        .detach();
+    return future;
+}
@@ -0,0 +1,518 @@
+#include "include/CopyTool/CopyEngine.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/file.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace
+{
+    constexpr auto IndexMagic = std::array<char, 8>{'C', 'T', 'D', 'E', 'D', 'U', 'P', '2'};
+    constexpr auto HashBufferSize = std::size_t{1024 * 1024};
+    constexpr auto InitialBucketCount = std::uint64_t{1024};
+
+    // Index layout: the header, a power-of-two table of slots probed linearly from the bucket of the key,
+    // then the path strings the slots point at. Lookups read the mapped file in place.
+    struct IndexHeader
+    {
+        std::array<char, 8> _magic;
+        std::uint64_t _bucketCount;
+        std::uint64_t _entryCount;
+        // End of the path strings; the file beyond it is preallocated room.
+        std::uint64_t _pathsEnd;
+    };
+
+    struct IndexSlot
+    {
+        std::uint64_t _hash;
+        std::uint64_t _size;
+        std::uint64_t _pathOffset;
+        std::uint32_t _pathLength;
+        std::uint32_t _used;
+    };
+
+    // Non-cryptographic 64-bit hash. Hits are always verified byte by byte before linking,
+    // so a collision can only cost a comparison, never a wrong copy.
+    class ContentHasher
+    {
+    public:
+        explicit ContentHasher(std::uint64_t size) : _state{0x9E3779B97F4A7C15ull ^ size} {}
+
+        void Update(const char *data, std::size_t size)
+        {
+            std::size_t i = 0;
+            for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data + i, sizeof(word));
+                mix(word);
+            }
+            if (i != size)
+            {
+                std::uint64_t word = 0;
+                std::memcpy(&word, data + i, size - i);
+                mix(word ^ (size - i));
+            }
+        }
+
+        std::uint64_t Finish() const
+        {
+            auto hash = _state;
+            hash ^= hash >> 30;
+            hash *= 0xBF58476D1CE4E5B9ull;
+            hash ^= hash >> 27;
+            hash *= 0x94D049BB133111EBull;
+            return hash ^ (hash >> 31);
+        }
+
+    private:
+        void mix(std::uint64_t word)
+        {
+            _state = std::rotl(_state ^ (word * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full;
+        }
+
+        std::uint64_t _state;
+    };
+
+    std::uint64_t IndexBucket(std::uint64_t hash, std::uint64_t size, std::uint64_t bucketCount)
+    {
+        return (hash ^ (size * 0x9E3779B97F4A7C15ull)) & (bucketCount - 1);
+    }
+
+    std::size_t ReadFully(NativeSource &file, char *data, std::size_t size)
+    {
+        auto total = std::size_t{0};
+        while (auto length = file.Read(data + total, size - total))
+        {
+            total += length;
+        }
+        return total;
+    }
+
+    bool EqualFiles(const std::filesystem::path &lhs, const std::filesystem::path &rhs)
+    {
+        auto lhsFile = NativeSource();
+        auto rhsFile = NativeSource();
+        lhsFile.Open(lhs);
+        rhsFile.Open(rhs);
+        if (lhsFile.Size() != rhsFile.Size())
+        {
+            return false;
+        }
+        auto lhsBuffer = std::vector<char>(CopyBufferSize(HashBufferSize, lhsFile.Size()));
+        auto rhsBuffer = std::vector<char>(lhsBuffer.size());
+        while (auto length = lhsFile.Read(lhsBuffer.data(), lhsBuffer.size()))
+        {
+            if (rhsFile.Read(rhsBuffer.data(), length) != length ||
+                std::memcmp(lhsBuffer.data(), rhsBuffer.data(), length) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Reflink(const std::filesystem::path &existing, const std::filesystem::path &destination)
+    {
+#if defined(__linux__) && defined(FICLONE)
+        auto source = FileDescriptor(::open(existing.c_str(), O_RDONLY | O_CLOEXEC));
+        if (source.Get() < 0)
+        {
+            return false;
+        }
+        auto target = FileDescriptor(::open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644));
+        if (target.Get() < 0)
+        {
+            return false;
+        }
+        if (::ioctl(target.Get(), FICLONE, source.Get()) == 0 && target.Close())
+        {
+            return true;
+        }
+        std::filesystem::remove(destination);
+#else
+        (void)existing;
+        (void)destination;
+#endif
+        return false;
+    }
+
+    // Exclusive flock on a file next to the index. The index itself is replaced by rename when it is rebuilt,
+    // so a lock on its inode would not keep out a process that has already opened the replacement.
+    class IndexLock
+    {
+    public:
+        explicit IndexLock(const std::filesystem::path &path)
+            : _file{::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)}
+        {
+            if (_file.Get() < 0)
+            {
+                throw std::runtime_error("File " + path.generic_string() + " cannot be opened");
+            }
+        }
+
+        void lock()
+        {
+            while (::flock(_file.Get(), LOCK_EX) != 0)
+            {
+                if (errno != EINTR)
+                {
+                    throw std::runtime_error("Dedup index lock cannot be taken");
+                }
+            }
+        }
+
+        void unlock()
+        {
+            ::flock(_file.Get(), LOCK_UN);
+        }
+
+    private:
+        FileDescriptor _file;
+    };
+
+    // Persistent hash table from (hash, size) to the paths written with that content. Opening only maps
+    // the file, so the cost at startup does not depend on how many copies the index has seen.
+    // Several processes may share the index: every lookup and update runs under the index lock and first
+    // remaps the file if another process has rebuilt or extended it.
+    class ContentIndex
+    {
+    public:
+        explicit ContentIndex(std::filesystem::path indexPath)
+            : _indexPath{std::move(indexPath)},
+              _lock{_indexPath.string() + ".lock"}
+        {
+            auto threadLock = std::lock_guard(_mutex);
+            auto processLock = std::lock_guard(_lock);
+            refresh();
+        }
+
+        std::vector<std::filesystem::path> Find(std::uint64_t hash, std::uintmax_t size)
+        {
+            auto threadLock = std::lock_guard(_mutex);
+            auto processLock = std::lock_guard(_lock);
+            refresh();
+            auto paths = std::vector<std::filesystem::path>();
+            for (auto bucket = firstBucket(hash, size); slots()[bucket]._used; bucket = nextBucket(bucket))
+            {
+                const auto &slot = slots()[bucket];
+                if (slot._hash == hash && slot._size == size)
+                {
+                    paths.push_back(slotPath(slot));
+                }
+            }
+            return paths;
+        }
+
+        void Add(std::uint64_t hash, std::uintmax_t size, const std::filesystem::path &path)
+        {
+            auto threadLock = std::lock_guard(_mutex);
+            auto processLock = std::lock_guard(_lock);
+            refresh();
+            add(hash, size, path.string());
+        }
+
+    private:
+        void add(std::uint64_t hash, std::uintmax_t size, const std::string &pathString)
+        {
+            auto bucket = firstBucket(hash, size);
+            for (; slots()[bucket]._used; bucket = nextBucket(bucket))
+            {
+                const auto &slot = slots()[bucket];
+                if (slot._hash == hash && slot._size == size && slotPath(slot) == pathString)
+                {
+                    return;
+                }
+            }
+            // The table is kept at most half full, so probe sequences stay short.
+            if (2 * (header()._entryCount + 1) > header()._bucketCount)
+            {
+                rebuild(2 * header()._bucketCount);
+                map();
+                add(hash, size, pathString);
+                return;
+            }
+            auto pathOffset = header()._pathsEnd;
+            if (pathOffset + pathString.size() > _region.get_size())
+            {
+                grow(pathOffset + pathString.size());
+            }
+            std::memcpy(data() + pathOffset, pathString.data(), pathString.size());
+            slots()[bucket] = IndexSlot{hash, size, pathOffset, static_cast<std::uint32_t>(pathString.size()), 1};
+            header()._pathsEnd = pathOffset + pathString.size();
+            ++header()._entryCount;
+        }
+
+        char *data() const
+        {
+            return static_cast<char *>(_region.get_address());
+        }
+
+        IndexHeader &header() const
+        {
+            return *reinterpret_cast<IndexHeader *>(data());
+        }
+
+        IndexSlot *slots() const
+        {
+            return reinterpret_cast<IndexSlot *>(data() + sizeof(IndexHeader));
+        }
+
+        std::uint64_t tableEnd() const
+        {
+            return sizeof(IndexHeader) + header()._bucketCount * sizeof(IndexSlot);
+        }
+
+        std::uint64_t firstBucket(std::uint64_t hash, std::uintmax_t size) const
+        {
+            return IndexBucket(hash, size, header()._bucketCount);
+        }
+
+        std::uint64_t nextBucket(std::uint64_t bucket) const
+        {
+            return (bucket + 1) & (header()._bucketCount - 1);
+        }
+
+        // Slots are checked when read rather than when mapped, so opening stays independent of the index size.
+        std::string slotPath(const IndexSlot &slot) const
+        {
+            auto pathsEnd = header()._pathsEnd;
+            if (pathsEnd > _region.get_size() || slot._pathOffset < tableEnd() || slot._pathOffset > pathsEnd ||
+                slot._pathLength > pathsEnd - slot._pathOffset)
+            {
+                throw corrupted();
+            }
+            return std::string(data() + slot._pathOffset, slot._pathLength);
+        }
+
+        std::runtime_error corrupted() const
+        {
+            return std::runtime_error("Dedup index " + _indexPath.generic_string() + " is corrupted");
+        }
+
+        // Maps the index again if another process has replaced or extended it since it was last mapped.
+        void refresh()
+        {
+            if (!std::filesystem::exists(_indexPath))
+            {
+                // A removed index starts afresh rather than bringing back the entries it had.
+                _region = boost::interprocess::mapped_region();
+                rebuild(InitialBucketCount);
+            }
+            struct stat status{};
+            if (::stat(_indexPath.c_str(), &status) != 0)
+            {
+                throw std::runtime_error("File " + _indexPath.generic_string() + " cannot be opened");
+            }
+            if (_region.get_size() == 0 || status.st_dev != _device || status.st_ino != _inode ||
+                static_cast<std::uintmax_t>(status.st_size) != _region.get_size())
+            {
+                map();
+            }
+        }
+
+        void map()
+        {
+            struct stat status{};
+            if (::stat(_indexPath.c_str(), &status) != 0)
+            {
+                throw std::runtime_error("File " + _indexPath.generic_string() + " cannot be opened");
+            }
+            auto size = static_cast<std::uintmax_t>(status.st_size);
+            if (size < sizeof(IndexHeader))
+            {
+                throw corrupted();
+            }
+            _region = boost::interprocess::mapped_region();
+            _mapping = boost::interprocess::file_mapping(_indexPath.string().c_str(), boost::interprocess::read_write);
+            _region = boost::interprocess::mapped_region(_mapping, boost::interprocess::read_write);
+            _device = status.st_dev;
+            _inode = status.st_ino;
+            const auto &indexHeader = header();
+            if (indexHeader._magic != IndexMagic || !std::has_single_bit(indexHeader._bucketCount) ||
+                indexHeader._bucketCount > (size - sizeof(IndexHeader)) / sizeof(IndexSlot) ||
+                indexHeader._pathsEnd < tableEnd() || indexHeader._pathsEnd > size ||
+                2 * indexHeader._entryCount > indexHeader._bucketCount)
+            {
+                _region = boost::interprocess::mapped_region();
+                throw corrupted();
+            }
+        }
+
+        // Extends the preallocated room for path strings at least up to size.
+        void grow(std::uint64_t size)
+        {
+            auto newSize = std::max<std::uint64_t>(size, 2 * _region.get_size());
+            _region = boost::interprocess::mapped_region();
+            std::filesystem::resize_file(_indexPath, newSize);
+            map();
+        }
+
+        // Writes a table of bucketCount slots holding the current entries to a new file that replaces the index.
+        void rebuild(std::uint64_t bucketCount)
+        {
+            auto newTableEnd = sizeof(IndexHeader) + bucketCount * sizeof(IndexSlot);
+            auto file = std::vector<char>(newTableEnd);
+            auto newHeader = IndexHeader{IndexMagic, bucketCount, 0, newTableEnd};
+            auto newSlots = reinterpret_cast<IndexSlot *>(file.data() + sizeof(IndexHeader));
+            if (_region.get_size() != 0)
+            {
+                for (std::uint64_t i = 0; i < header()._bucketCount; ++i)
+                {
+                    auto slot = slots()[i];
+                    if (!slot._used)
+                    {
+                        continue;
+                    }
+                    auto bucket = IndexBucket(slot._hash, slot._size, bucketCount);
+                    while (newSlots[bucket]._used)
+                    {
+                        bucket = (bucket + 1) & (bucketCount - 1);
+                    }
+                    auto path = slotPath(slot);
+                    file.insert(file.end(), path.begin(), path.end());
+                    newSlots = reinterpret_cast<IndexSlot *>(file.data() + sizeof(IndexHeader));
+                    slot._pathOffset = newHeader._pathsEnd;
+                    newSlots[bucket] = slot;
+                    newHeader._pathsEnd += slot._pathLength;
+                    ++newHeader._entryCount;
+                }
+                _region = boost::interprocess::mapped_region();
+            }
+            std::memcpy(file.data(), &newHeader, sizeof(newHeader));
+            auto temporaryPath = std::filesystem::path(_indexPath.string() + ".tmp");
+            auto indexFile = std::ofstream(temporaryPath, std::ios::binary | std::ios::trunc);
+            indexFile.write(file.data(), static_cast<std::streamsize>(file.size()));
+            indexFile.close();
+            if (!indexFile)
+            {
+                throw std::runtime_error("Dedup index " + _indexPath.generic_string() + " cannot be updated");
+            }
+            std::filesystem::rename(temporaryPath, _indexPath);
+        }
+
+        std::filesystem::path _indexPath;
+        std::mutex _mutex;
+        IndexLock _lock;
+        boost::interprocess::file_mapping _mapping;
+        boost::interprocess::mapped_region _region;
+        dev_t _device = 0;
+        ino_t _inode = 0;
+    };
+
+    class DedupCopyTool : public ICopyTool
+    {
+    public:
+        DedupCopyTool(ICopyToolPtrU copyTool, std::filesystem::path indexPath, bool allowHardLinks)
+            : _copyTool{std::move(copyTool)},
+              _index{std::move(indexPath)},
+              _allowHardLinks{allowHardLinks}
+        {
+        }
+
+        void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination) override
+        {
+            // The index key covers the size and the first block only, so a miss reads just that block
+            // and a hit reads the source once, comparing it with the candidate on the way.
+            auto sourceFile = NativeSource();
+            sourceFile.Open(source);
+            auto size = sourceFile.Size();
+            auto buffer = std::vector<char>(CopyBufferSize(HashBufferSize, size));
+            auto length = ReadFully(sourceFile, buffer.data(), buffer.size());
+            auto hasher = ContentHasher(size);
+            hasher.Update(buffer.data(), length);
+            auto hash = hasher.Finish();
+            auto canonicalDestination = std::filesystem::weakly_canonical(destination);
+            if (!linkExisting(source, sourceFile, buffer, length, hash, size, canonicalDestination))
+            {
+                _copyTool->CopyFile(source, destination);
+            }
+            _index.Add(hash, size, canonicalDestination);
+        }
+
+    private:
+        // Satisfies the copy from an indexed file with identical content. The destination is left as is
+        // when it already holds that content, otherwise it is replaced by a reflink or, if allowed, a hard link.
+        bool linkExisting(const std::filesystem::path &source, NativeSource &sourceFile, std::vector<char> &buffer,
+                          std::size_t length, std::uint64_t hash, std::uintmax_t size,
+                          const std::filesystem::path &destination)
+        {
+            auto sourceConsumed = false;
+            for (const auto &candidate : _index.Find(hash, size))
+            {
+                auto error = std::error_code{};
+                if (!std::filesystem::is_regular_file(candidate, error) || std::filesystem::file_size(candidate, error) != size)
+                {
+                    continue;
+                }
+                // Only the first comparison can continue the open source; later ones are rare enough to reread it.
+                auto equal = sourceConsumed ? EqualFiles(candidate, source)
+                                            : equalsRest(sourceFile, buffer, length, candidate);
+                sourceConsumed = true;
+                if (!equal)
+                {
+                    continue;
+                }
+                if (candidate == destination)
+                {
+                    return true;
+                }
+                std::filesystem::remove(destination);
+                if (Reflink(candidate, destination))
+                {
+                    return true;
+                }
+                if (_allowHardLinks)
+                {
+                    std::filesystem::create_hard_link(candidate, destination, error);
+                    if (!error)
+                    {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // Compares candidate with the first block already in buffer and the rest of sourceFile.
+        static bool equalsRest(NativeSource &sourceFile, std::vector<char> &buffer, std::size_t length,
+                               const std::filesystem::path &candidate)
+        {
+            auto candidateFile = NativeSource();
+            candidateFile.Open(candidate);
+            auto candidateBuffer = std::vector<char>(buffer.size());
+            while (length != 0)
+            {
+                if (ReadFully(candidateFile, candidateBuffer.data(), length) != length ||
+                    std::memcmp(buffer.data(), candidateBuffer.data(), length) != 0)
+                {
+                    return false;
+                }
+                length = ReadFully(sourceFile, buffer.data(), buffer.size());
+            }
+            return candidateFile.Read(candidateBuffer.data(), 1) == 0;
+        }
+
+        ICopyToolPtrU _copyTool;
+        ContentIndex _index;
+        bool _allowHardLinks;
+    };
+}
+
+ICopyToolPtrU CreateDedupCopyTool(ICopyToolPtrU copyTool, std::filesystem::path indexPath, bool allowHardLinks)
+{
+    return std::make_unique<DedupCopyTool>(std::move(copyTool), std::move(indexPath), allowHardLinks);
+}
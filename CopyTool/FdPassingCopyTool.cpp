@@ -0,0 +1,354 @@
+#include "include/CopyTool/CopyEngine.h"
+
+#include <iostream>
+#include <string>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+namespace
+{
+    constexpr auto KernelCopyChunk = std::size_t{16 * 1024 * 1024};
+    constexpr auto ConnectTimeout = std::chrono::seconds(5);
+
+    enum class MessageType : std::uint32_t
+    {
+        // Reader -> writer, carries the source descriptor and its size.
+        Offer,
+        // Writer -> reader, bytes copied so far.
+        Progress,
+        Done,
+        Failed
+    };
+
+    struct ControlMessage
+    {
+        MessageType _type;
+        std::uint32_t _reserved;
+        std::uint64_t _bytes;
+    };
+
+    // Both processes address the session through the abstract socket namespace,
+    // so nothing is left in the filesystem when a process dies.
+    sockaddr_un SessionAddress(const std::string &sessionName, socklen_t &length)
+    {
+        auto address = sockaddr_un{};
+        address.sun_family = AF_UNIX;
+        auto name = "CopyTool." + sessionName;
+        if (name.size() >= sizeof(address.sun_path))
+        {
+            throw std::runtime_error("Session name " + sessionName + " is too long");
+        }
+        std::memcpy(address.sun_path + 1, name.data(), name.size());
+        length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+        return address;
+    }
+
+    void SendMessage(int socket, ControlMessage message, int fd = -1)
+    {
+        auto data = iovec{&message, sizeof(message)};
+        auto header = msghdr{};
+        header.msg_iov = &data;
+        header.msg_iovlen = 1;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        if (fd >= 0)
+        {
+            header.msg_control = control;
+            header.msg_controllen = sizeof(control);
+            auto controlHeader = CMSG_FIRSTHDR(&header);
+            controlHeader->cmsg_level = SOL_SOCKET;
+            controlHeader->cmsg_type = SCM_RIGHTS;
+            controlHeader->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(controlHeader), &fd, sizeof(int));
+        }
+        if (::sendmsg(socket, &header, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(message)))
+        {
+            throw std::runtime_error("Control message cannot be sent to the peer");
+        }
+    }
+
+    ControlMessage ReceiveMessage(int socket, FileDescriptor *fd = nullptr)
+    {
+        auto message = ControlMessage{};
+        auto data = iovec{&message, sizeof(message)};
+        auto header = msghdr{};
+        header.msg_iov = &data;
+        header.msg_iovlen = 1;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+        auto result = ::recvmsg(socket, &header, MSG_CMSG_CLOEXEC);
+        if (result != static_cast<ssize_t>(sizeof(message)))
+        {
+            throw std::runtime_error("Peer disconnected");
+        }
+        for (auto controlHeader = CMSG_FIRSTHDR(&header); controlHeader; controlHeader = CMSG_NXTHDR(&header, controlHeader))
+        {
+            if (controlHeader->cmsg_level == SOL_SOCKET && controlHeader->cmsg_type == SCM_RIGHTS)
+            {
+                int received;
+                std::memcpy(&received, CMSG_DATA(controlHeader), sizeof(int));
+                if (fd)
+                {
+                    *fd = FileDescriptor(received);
+                }
+                else
+                {
+                    ::close(received);
+                }
+            }
+        }
+        return message;
+    }
+
+    // Copies size bytes inside the kernel, falling back from copy_file_range to sendfile
+    // when the filesystem pair does not support it.
+    std::size_t KernelCopy(int source, int destination, std::size_t size, bool &useCopyFileRange)
+    {
+        while (true)
+        {
+            auto result = useCopyFileRange ? ::copy_file_range(source, nullptr, destination, nullptr, size, 0)
+                                           : ::sendfile(destination, source, nullptr, size);
+            if (result >= 0)
+            {
+                return static_cast<std::size_t>(result);
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (useCopyFileRange && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+            {
+                useCopyFileRange = false;
+                continue;
+            }
+            throw std::runtime_error("Kernel copy failed: " + std::string(std::strerror(errno)));
+        }
+    }
+
+    class FdPassingCopyTool : public ICopyTool
+    {
+    public:
+        FdPassingCopyTool(std::string_view sessionName, WritebackOptions writeback, IoPriority priority, bool smallFileCopy)
+            : _sessionName{sessionName},
+              _writeback{writeback},
+              _priority{priority},
+              _smallFileCopy{smallFileCopy}
+        {
+            _socket = FileDescriptor(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+            if (_socket.Get() < 0)
+            {
+                throw std::runtime_error("Unix domain socket cannot be created");
+            }
+            socklen_t length;
+            auto address = SessionAddress(_sessionName, length);
+            // Whoever binds the session address first reads, the second process writes.
+            if (::bind(_socket.Get(), reinterpret_cast<sockaddr *>(&address), length) == 0 && ::listen(_socket.Get(), 1) == 0)
+            {
+                _mode = CopyToolMode::Reader;
+            }
+            else if (errno == EADDRINUSE)
+            {
+                _mode = CopyToolMode::Writer;
+            }
+            else
+            {
+                throw std::runtime_error("Session " + _sessionName + " cannot be opened");
+            }
+            std::cout << "Fd passing copy tool constructed. Mode: "
+                      << (_mode == CopyToolMode::Reader ? "Reader." : "Writer.") << std::endl;
+        }
+
+        void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination) override
+        {
+            if (_mode == CopyToolMode::Reader)
+            {
+                read(source, destination);
+            }
+            else
+            {
+                write(destination);
+            }
+        }
+
+    private:
+        enum CopyToolMode
+        {
+            Reader,
+            Writer
+        };
+
+        void read(const std::filesystem::path &source, const std::filesystem::path &destination)
+        {
+            // A small file is copied here and the writer gets Done in place of an Offer, leaving it nothing to write.
+            if (_smallFileCopy)
+            {
+                if (auto length = TryCopySmallFile(source, destination, SmallFileLimit, _writeback, _priority))
+                {
+                    if (auto connection = accept(); connection.Get() >= 0)
+                    {
+                        SendMessage(connection.Get(), ControlMessage{MessageType::Done, 0, *length});
+                    }
+                    std::cout << "Processed data length: " << *length << std::endl;
+                    return;
+                }
+            }
+            auto sourceFile = NativeSource();
+            sourceFile.Open(source);
+
+            auto connection = accept();
+            if (connection.Get() < 0)
+            {
+                std::cout << "Reader timed out waiting for the writer to start. Nothing to do." << std::endl;
+                return;
+            }
+
+            SendMessage(connection.Get(), ControlMessage{MessageType::Offer, 0, sourceFile.Size()}, sourceFile.Descriptor());
+            try
+            {
+                while (true)
+                {
+                    auto message = ReceiveMessage(connection.Get());
+                    if (message._type == MessageType::Done)
+                    {
+                        std::cout << "Processed data length: " << message._bytes << std::endl;
+                        return;
+                    }
+                    if (message._type == MessageType::Failed)
+                    {
+                        throw std::runtime_error("Writer failed after " + std::to_string(message._bytes) + " bytes");
+                    }
+                }
+            }
+            catch (...)
+            {
+                // A writer killed in the middle of the copy cannot remove its partial destination.
+                std::filesystem::remove(destination);
+                throw;
+            }
+        }
+
+        void write(const std::filesystem::path &destination)
+        {
+            auto connection = connect();
+            auto sourceFile = FileDescriptor();
+            auto offer = ReceiveMessage(connection.Get(), &sourceFile);
+            if (offer._type == MessageType::Done)
+            {
+                std::cout << "Reader copied the small file on its own. Processed data length: " << offer._bytes << std::endl;
+                return;
+            }
+            if (offer._type != MessageType::Offer || sourceFile.Get() < 0)
+            {
+                throw std::runtime_error("Reader did not pass the source descriptor");
+            }
+
+            std::uint64_t copied = 0;
+            try
+            {
+                std::filesystem::remove(destination);
+                auto destinationFile = FileDescriptor(::open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644));
+                if (destinationFile.Get() < 0)
+                {
+                    throw std::runtime_error("File " + destination.generic_string() + " cannot be opened for writing");
+                }
+                auto writeBehind = WriteBehind();
+                writeBehind.Start(destinationFile.Get(), offer._bytes, _writeback);
+                auto useCopyFileRange = true;
+                // The passed descriptor shares its file offset with the reader, which no longer touches it.
+                while (true)
+                {
+                    auto length = std::size_t{0};
+                    auto remaining = offer._bytes > copied ? offer._bytes - copied : 0;
+                    {
+                        auto io = ScheduledIo(_priority, static_cast<std::size_t>(std::min<std::uint64_t>(KernelCopyChunk, remaining)));
+                        length = KernelCopy(sourceFile.Get(), destinationFile.Get(), KernelCopyChunk, useCopyFileRange);
+                    }
+                    if (length == 0)
+                    {
+                        break;
+                    }
+                    copied += length;
+                    writeBehind.Advance(length);
+                    SendMessage(connection.Get(), ControlMessage{MessageType::Progress, 0, copied});
+                }
+                writeBehind.Finish();
+                if (!destinationFile.Close())
+                {
+                    throw std::runtime_error("File " + destination.generic_string() + " cannot be written");
+                }
+                // Inside the try: a reader that is gone by now never learns the copy completed.
+                SendMessage(connection.Get(), ControlMessage{MessageType::Done, 0, copied});
+            }
+            catch (...)
+            {
+                std::filesystem::remove(destination);
+                SendMessage(connection.Get(), ControlMessage{MessageType::Failed, 0, copied});
+                throw;
+            }
+            std::cout << "Processed data length: " << copied << std::endl;
+        }
+
+        // Invalid when the writer does not connect in time.
+        FileDescriptor accept()
+        {
+            auto listener = pollfd{_socket.Get(), POLLIN, 0};
+            if (::poll(&listener, 1, static_cast<int>(std::chrono::milliseconds(ConnectTimeout).count())) <= 0)
+            {
+                return FileDescriptor();
+            }
+            auto connection = FileDescriptor(::accept4(_socket.Get(), nullptr, nullptr, SOCK_CLOEXEC));
+            if (connection.Get() < 0)
+            {
+                throw std::runtime_error("Writer connection cannot be accepted");
+            }
+            return connection;
+        }
+
+        FileDescriptor connect()
+        {
+            socklen_t length;
+            auto address = SessionAddress(_sessionName, length);
+            auto deadline = std::chrono::steady_clock::now() + ConnectTimeout;
+            while (true)
+            {
+                auto connection = FileDescriptor(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+                if (::connect(connection.Get(), reinterpret_cast<sockaddr *>(&address), length) == 0)
+                {
+                    return connection;
+                }
+                if (std::chrono::steady_clock::now() >= deadline)
+                {
+                    throw std::runtime_error("Reader of session " + _sessionName + " is not reachable");
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        std::string _sessionName;
+        WritebackOptions _writeback;
+        IoPriority _priority;
+        bool _smallFileCopy;
+        FileDescriptor _socket;
+        CopyToolMode _mode;
+    };
+}
+
+ICopyToolPtrU CreateFdPassingCopyTool(std::string_view sessionName, WritebackOptions writeback, IoPriority priority, bool smallFileCopy)
+{
+    return std::make_unique<FdPassingCopyTool>(sessionName, writeback, priority, smallFileCopy);
+}
+#else
+ICopyToolPtrU CreateFdPassingCopyTool(std::string_view /*sessionName*/, WritebackOptions /*writeback*/, IoPriority /*priority*/,
+                                      bool /*smallFileCopy*/)
+{
+    throw std::runtime_error("Fd passing copy tool is only supported on Linux");
+}
+#endif
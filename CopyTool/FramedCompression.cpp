@@ -0,0 +1,378 @@
+#include "include/CopyTool/FramedCompression.h"
+#include "include/CopyTool/CopyEngine.h"
+
+#ifdef COPY_TOOL_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef COPY_TOOL_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include <array>
+#include <limits>
+#include <memory>
+#include <thread>
+
+namespace
+{
+    constexpr auto FileMagic = std::array<char, 8>{'C', 'T', 'F', 'R', 'A', 'M', 'E', '1'};
+    constexpr auto FooterMagic = std::array<char, 8>{'C', 'T', 'S', 'E', 'E', 'K', '0', '1'};
+
+    struct FileHeader
+    {
+        std::array<char, 8> _magic;
+        CompressionCodec _codec;
+        std::uint32_t _frameSize;
+        std::uint64_t _size;
+    };
+
+    // A frame is stored raw when _storedSize equals _size.
+    struct FrameHeader
+    {
+        std::uint32_t _storedSize;
+        std::uint32_t _size;
+    };
+
+    struct Footer
+    {
+        std::uint64_t _frameCount;
+        std::array<char, 8> _magic;
+    };
+
+    // Frames are compressed or decompressed at most this many ahead of the one being written or read.
+    std::size_t FramesInFlight()
+    {
+        return 2 * std::max(2u, std::thread::hardware_concurrency());
+    }
+
+    std::uint64_t FrameCount(std::uintmax_t size, std::size_t frameSize)
+    {
+        return (size + frameSize - 1) / frameSize;
+    }
+
+    void CheckHeader(const FileHeader &header)
+    {
+        if (header._magic != FileMagic || header._frameSize == 0 ||
+            (header._codec != CompressionCodec::Lz4 && header._codec != CompressionCodec::Zstd))
+        {
+            throw std::runtime_error("Source is not in the framed format");
+        }
+    }
+
+    void CheckCodec(CompressionCodec codec)
+    {
+        if (!IsCodecAvailable(codec))
+        {
+            throw std::runtime_error(std::string("CopyTool is built without ") + (codec == CompressionCodec::Lz4 ? "lz4" : "zstd"));
+        }
+    }
+
+    // Returns the compressed size, or 0 when the payload does not fit into capacity.
+    std::size_t Compress(const CompressionOptions &options, const char *content, std::size_t size, char *payload, std::size_t capacity)
+    {
+        if (options._codec == CompressionCodec::Lz4)
+        {
+#ifdef COPY_TOOL_WITH_LZ4
+            auto result = LZ4_compress_default(content, payload, static_cast<int>(size), static_cast<int>(capacity));
+            return result > 0 ? static_cast<std::size_t>(result) : 0;
+#endif
+        }
+        else
+        {
+#ifdef COPY_TOOL_WITH_ZSTD
+            thread_local auto context = std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)>(ZSTD_createCCtx(), ZSTD_freeCCtx);
+            auto result = ZSTD_compressCCtx(context.get(), payload, capacity, content, size, options._level);
+            return ZSTD_isError(result) ? 0 : result;
+#endif
+        }
+        (void)content;
+        (void)size;
+        (void)payload;
+        (void)capacity;
+        return 0;
+    }
+
+    bool Decompress(CompressionCodec codec, const std::vector<char> &payload, std::vector<char> &content)
+    {
+        if (codec == CompressionCodec::Lz4)
+        {
+#ifdef COPY_TOOL_WITH_LZ4
+            return LZ4_decompress_safe(payload.data(), content.data(), static_cast<int>(payload.size()),
+                                       static_cast<int>(content.size())) == static_cast<int>(content.size());
+#endif
+        }
+        else
+        {
+#ifdef COPY_TOOL_WITH_ZSTD
+            thread_local auto context = std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)>(ZSTD_createDCtx(), ZSTD_freeDCtx);
+            return ZSTD_decompressDCtx(context.get(), content.data(), content.size(), payload.data(), payload.size()) == content.size();
+#endif
+        }
+        (void)payload;
+        (void)content;
+        return false;
+    }
+
+    // Returns the frame header followed by the payload. Data that does not shrink is stored raw,
+    // so the payload never needs more room than the content itself.
+    std::vector<char> EncodeFrame(const CompressionOptions &options, const std::vector<char> &content)
+    {
+        auto size = content.size();
+        auto frame = std::vector<char>(sizeof(FrameHeader) + size);
+        auto payload = frame.data() + sizeof(FrameHeader);
+        // Without the codec, or with nothing to shrink, the frame is stored raw right away.
+        auto storedSize = size != 0 && IsCodecAvailable(options._codec) ? Compress(options, content.data(), size, payload, size - 1) : 0;
+        if (storedSize == 0 || storedSize >= size)
+        {
+            storedSize = size;
+            frame.resize(sizeof(FrameHeader));
+            frame.insert(frame.end(), content.begin(), content.end());
+        }
+        auto header = FrameHeader{static_cast<std::uint32_t>(storedSize), static_cast<std::uint32_t>(size)};
+        std::memcpy(frame.data(), &header, sizeof(header));
+        frame.resize(sizeof(FrameHeader) + storedSize);
+        return frame;
+    }
+
+    std::vector<char> DecodeFrame(CompressionCodec codec, const FrameHeader &header, std::vector<char> payload)
+    {
+        if (header._storedSize == header._size)
+        {
+            return payload;
+        }
+        auto content = std::vector<char>(header._size);
+        if (!Decompress(codec, payload, content))
+        {
+            throw std::runtime_error("Framed source has a corrupted frame");
+        }
+        return content;
+    }
+
+    template <class Function>
+    std::future<std::vector<char>> PostFrameTask(Function function)
+    {
+        auto task = std::make_shared<std::packaged_task<std::vector<char>()>>(std::move(function));
+        auto future = task->get_future();
+        PostCompressionTask([task]()
+                            { (*task)(); });
+        return future;
+    }
+}
+
+bool IsCodecAvailable(CompressionCodec codec)
+{
+#ifdef COPY_TOOL_WITH_LZ4
+    if (codec == CompressionCodec::Lz4)
+    {
+        return true;
+    }
+#endif
+#ifdef COPY_TOOL_WITH_ZSTD
+    if (codec == CompressionCodec::Zstd)
+    {
+        return true;
+    }
+#endif
+    (void)codec;
+    return false;
+}
+
+FrameEncoder::FrameEncoder(CompressionOptions options, Output output)
+    : _options{options},
+      _output{std::move(output)}
+{
+    if (_options._frameSize == 0 || _options._frameSize > std::numeric_limits<std::uint32_t>::max() / 2)
+    {
+        throw std::runtime_error("Frame size " + std::to_string(_options._frameSize) + " is not supported");
+    }
+    CheckCodec(_options._codec);
+}
+
+void FrameEncoder::Begin(std::uintmax_t size)
+{
+    _size = size;
+    auto header = FileHeader{FileMagic, _options._codec, static_cast<std::uint32_t>(_options._frameSize), size};
+    _output(reinterpret_cast<const char *>(&header), sizeof(header));
+    _offset = sizeof(header);
+    _frameOffsets.reserve(FrameCount(size, _options._frameSize));
+    _pending.reserve(_options._frameSize);
+}
+
+void FrameEncoder::Write(const char *data, std::size_t size)
+{
+    while (size != 0)
+    {
+        auto length = std::min(size, _options._frameSize - _pending.size());
+        _pending.insert(_pending.end(), data, data + length);
+        data += length;
+        size -= length;
+        if (_pending.size() == _options._frameSize)
+        {
+            submit();
+        }
+    }
+}
+
+void FrameEncoder::Finish()
+{
+    if (!_pending.empty())
+    {
+        submit();
+    }
+    while (!_frames.empty())
+    {
+        writeFront();
+    }
+    if (_received != _size)
+    {
+        throw std::runtime_error("Source size changed while it was compressed");
+    }
+    _output(reinterpret_cast<const char *>(_frameOffsets.data()), _frameOffsets.size() * sizeof(std::uint64_t));
+    auto footer = Footer{_frameOffsets.size(), FooterMagic};
+    _output(reinterpret_cast<const char *>(&footer), sizeof(footer));
+}
+
+void FrameEncoder::submit()
+{
+    _received += _pending.size();
+    _frames.push_back(PostFrameTask([options = _options, content = std::move(_pending)]()
+                                    { return EncodeFrame(options, content); }));
+    _pending = std::vector<char>();
+    _pending.reserve(_options._frameSize);
+    while (_frames.size() > FramesInFlight())
+    {
+        writeFront();
+    }
+}
+
+void FrameEncoder::writeFront()
+{
+    auto frame = _frames.front().get();
+    _frames.pop_front();
+    _output(frame.data(), frame.size());
+    _frameOffsets.push_back(_offset);
+    _offset += frame.size();
+}
+
+FrameDecoder::FrameDecoder(Input input) : _input{std::move(input)} {}
+
+std::uintmax_t FrameDecoder::Begin()
+{
+    auto header = FileHeader{};
+    if (_input(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header))
+    {
+        throw std::runtime_error("Source is not in the framed format");
+    }
+    CheckHeader(header);
+    CheckCodec(header._codec);
+    _codec = header._codec;
+    _frameSize = header._frameSize;
+    _unread = header._size;
+    prefetch();
+    return header._size;
+}
+
+std::size_t FrameDecoder::Read(char *data, std::size_t size)
+{
+    std::size_t total = 0;
+    while (total < size)
+    {
+        if (_currentOffset == _current.size())
+        {
+            if (_frames.empty())
+            {
+                break;
+            }
+            _current = _frames.front().get();
+            _frames.pop_front();
+            _currentOffset = 0;
+            prefetch();
+        }
+        auto length = std::min(size - total, _current.size() - _currentOffset);
+        std::memcpy(data + total, _current.data() + _currentOffset, length);
+        _currentOffset += length;
+        total += length;
+    }
+    return total;
+}
+
+void FrameDecoder::prefetch()
+{
+    while (_unread != 0 && _frames.size() < FramesInFlight())
+    {
+        auto header = FrameHeader{};
+        auto expectedSize = static_cast<std::size_t>(std::min<std::uintmax_t>(_unread, _frameSize));
+        if (_input(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header) ||
+            header._size != expectedSize || header._storedSize > header._size)
+        {
+            throw std::runtime_error("Framed source is truncated or corrupted");
+        }
+        auto payload = std::vector<char>(header._storedSize);
+        if (_input(payload.data(), payload.size()) != payload.size())
+        {
+            throw std::runtime_error("Framed source is truncated or corrupted");
+        }
+        _frames.push_back(PostFrameTask([codec = _codec, header, payload = std::move(payload)]() mutable
+                                        { return DecodeFrame(codec, header, std::move(payload)); }));
+        _unread -= expectedSize;
+    }
+}
+
+FramedFileReader::FramedFileReader(const std::filesystem::path &path)
+    : _path{path},
+      _file{path, std::ios::binary}
+{
+    auto header = FileHeader{};
+    auto footer = Footer{};
+    if (!_file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        !_file.seekg(-static_cast<std::streamoff>(sizeof(footer)), std::ios::end) ||
+        !_file.read(reinterpret_cast<char *>(&footer), sizeof(footer)))
+    {
+        throw std::runtime_error("File " + _path.generic_string() + " is not in the framed format");
+    }
+    CheckHeader(header);
+    CheckCodec(header._codec);
+    _codec = header._codec;
+    _frameSize = header._frameSize;
+    _size = header._size;
+    if (footer._magic != FooterMagic || footer._frameCount != FrameCount(_size, _frameSize))
+    {
+        throw std::runtime_error("File " + _path.generic_string() + " has no valid seek table");
+    }
+    _frameOffsets.resize(footer._frameCount);
+    auto tableSize = static_cast<std::streamoff>(_frameOffsets.size() * sizeof(std::uint64_t));
+    if (!_file.seekg(-static_cast<std::streamoff>(sizeof(footer)) - tableSize, std::ios::end) ||
+        !_file.read(reinterpret_cast<char *>(_frameOffsets.data()), tableSize))
+    {
+        throw std::runtime_error("File " + _path.generic_string() + " has no valid seek table");
+    }
+}
+
+std::size_t FramedFileReader::ReadAt(std::uintmax_t offset, char *data, std::size_t size)
+{
+    std::size_t total = 0;
+    while (total < size && offset < _size)
+    {
+        auto index = offset / _frameSize;
+        auto expectedSize = std::min<std::uintmax_t>(_size - index * _frameSize, _frameSize);
+        auto header = FrameHeader{};
+        if (!_file.seekg(static_cast<std::streamoff>(_frameOffsets[index])) ||
+            !_file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+            header._size != expectedSize || header._storedSize > header._size)
+        {
+            throw std::runtime_error("File " + _path.generic_string() + " has a corrupted frame");
+        }
+        auto payload = std::vector<char>(header._storedSize);
+        if (!_file.read(payload.data(), static_cast<std::streamsize>(payload.size())))
+        {
+            throw std::runtime_error("File " + _path.generic_string() + " has a corrupted frame");
+        }
+        auto content = DecodeFrame(_codec, header, std::move(payload));
+        auto frameOffset = static_cast<std::size_t>(offset - index * _frameSize);
+        auto length = std::min(size - total, content.size() - frameOffset);
+        std::memcpy(data + total, content.data() + frameOffset, length);
+        total += length;
+        offset += length;
+    }
+    return total;
+}
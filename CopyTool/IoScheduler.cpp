@@ -0,0 +1,236 @@
+#include "include/CopyTool/IoScheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Idle buckets fill up to this much of their rate, so short bursts are not delayed.
+    constexpr auto BurstDuration = std::chrono::milliseconds(100);
+    constexpr auto ControlWindow = std::chrono::milliseconds(200);
+    constexpr auto MinWindowSamples = std::size_t{16};
+    constexpr auto MinBackgroundRate = std::uint64_t{1024 * 1024};
+    // How soon a background operation held back by waiting foreground operations asks again.
+    constexpr auto ForegroundRetryDelay = std::chrono::milliseconds(1);
+}
+
+IoScheduler &IoScheduler::Instance()
+{
+    static IoScheduler scheduler;
+    return scheduler;
+}
+
+void IoScheduler::SetLimits(IoLimits limits)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto now = Clock::now();
+        _limits = limits;
+        _bytes.SetRate(limits._bytesPerSecond, now);
+        _operations.SetRate(limits._operationsPerSecond, now);
+        updateActive();
+    }
+    _conditionalVariable.notify_all();
+}
+
+IoLimits IoScheduler::GetLimits() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _limits;
+}
+
+void IoScheduler::SetForegroundLatencyTarget(std::chrono::microseconds target)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _latencyTarget = target.count();
+        _background.SetRate(0, Clock::now());
+        _windowStart = Clock::now();
+        _backgroundBytes = 0;
+        _foregroundSamples.clear();
+        _backgroundSamples.clear();
+        updateActive();
+    }
+    _conditionalVariable.notify_all();
+}
+
+std::chrono::microseconds IoScheduler::GetForegroundLatencyTarget() const
+{
+    return std::chrono::microseconds(_latencyTarget.load());
+}
+
+std::uint64_t IoScheduler::GetBackgroundRate() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _background.Rate();
+}
+
+void IoScheduler::Acquire(IoPriority priority, std::size_t bytes)
+{
+    if (!_active.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto foreground = priority == IoPriority::Foreground;
+    if (foreground)
+    {
+        ++_foregroundWaiting;
+    }
+    while (true)
+    {
+        auto now = Clock::now();
+        auto wait = std::max(_bytes.Wait(now), _operations.Wait(now));
+        if (!foreground)
+        {
+            wait = std::max(wait, _background.Wait(now));
+            if (wait == Clock::duration::zero() && _foregroundWaiting != 0)
+            {
+                _conditionalVariable.wait(lock);
+                continue;
+            }
+        }
+        if (wait == Clock::duration::zero())
+        {
+            break;
+        }
+        _conditionalVariable.wait_for(lock, wait);
+    }
+    take(priority, bytes);
+    if (foreground && --_foregroundWaiting == 0)
+    {
+        _conditionalVariable.notify_all();
+    }
+}
+
+IoReservation IoScheduler::TryReserve(IoPriority priority, std::size_t bytes)
+{
+    if (!_active.load(std::memory_order_relaxed))
+    {
+        return IoReservation{true};
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto now = Clock::now();
+    auto wait = std::max(_bytes.Wait(now), _operations.Wait(now));
+    if (priority == IoPriority::Background)
+    {
+        wait = std::max(wait, _background.Wait(now));
+        if (wait != Clock::duration::zero())
+        {
+            return IoReservation{false, wait};
+        }
+        if (_foregroundWaiting != 0)
+        {
+            return IoReservation{false, ForegroundRetryDelay};
+        }
+    }
+    // The foreground tokens put the buckets into debt, which every later operation waits out.
+    take(priority, bytes);
+    return IoReservation{true, wait};
+}
+
+void IoScheduler::ReportLatency(IoPriority priority, std::chrono::nanoseconds latency)
+{
+    if (!TracksLatency())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        (priority == IoPriority::Foreground ? _foregroundSamples : _backgroundSamples).push_back(latency);
+        auto now = Clock::now();
+        if (now - _windowStart < ControlWindow)
+        {
+            return;
+        }
+        adjustBackgroundRate(now);
+    }
+    _conditionalVariable.notify_all();
+}
+
+void IoScheduler::take(IoPriority priority, std::size_t bytes)
+{
+    _bytes.Take(static_cast<double>(bytes));
+    _operations.Take(1);
+    if (priority == IoPriority::Background)
+    {
+        _background.Take(static_cast<double>(bytes));
+        _backgroundBytes += bytes;
+    }
+}
+
+void IoScheduler::updateActive()
+{
+    _active = _limits._bytesPerSecond != 0 || _limits._operationsPerSecond != 0 || _latencyTarget != 0;
+}
+
+void IoScheduler::adjustBackgroundRate(Clock::time_point now)
+{
+    auto &samples = _foregroundSamples.empty() ? _backgroundSamples : _foregroundSamples;
+    if (samples.size() < MinWindowSamples)
+    {
+        return;
+    }
+    auto p99 = samples.begin() + static_cast<std::ptrdiff_t>(samples.size() * 99 / 100);
+    std::nth_element(samples.begin(), p99, samples.end());
+    auto seconds = std::chrono::duration<double>(now - _windowStart).count();
+    auto throughput = static_cast<std::uint64_t>(static_cast<double>(_backgroundBytes) / seconds);
+    auto rate = _background.Rate();
+    if (*p99 > std::chrono::microseconds(_latencyTarget.load()))
+    {
+        if (_backgroundBytes != 0)
+        {
+            rate = std::max(MinBackgroundRate, (rate == 0 ? throughput : std::min(rate, throughput)) / 2);
+        }
+    }
+    else if (rate != 0)
+    {
+        rate += rate / 4;
+        // The cap is lifted once it no longer holds background copies back.
+        auto ceiling = _limits._bytesPerSecond != 0 ? _limits._bytesPerSecond : 4 * throughput;
+        if (rate >= ceiling)
+        {
+            rate = 0;
+        }
+    }
+    _background.SetRate(rate, now);
+    _windowStart = now;
+    _backgroundBytes = 0;
+    _foregroundSamples.clear();
+    _backgroundSamples.clear();
+}
+
+void IoScheduler::TokenBucket::SetRate(std::uint64_t rate, Clock::time_point now)
+{
+    refill(now);
+    _rate = rate;
+    _tokens = std::min(_tokens, static_cast<double>(_rate) * std::chrono::duration<double>(BurstDuration).count());
+}
+
+IoScheduler::Clock::duration IoScheduler::TokenBucket::Wait(Clock::time_point now)
+{
+    refill(now);
+    if (_rate == 0 || _tokens >= 0)
+    {
+        return Clock::duration::zero();
+    }
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-_tokens / static_cast<double>(_rate))) +
+           Clock::duration(1);
+}
+
+void IoScheduler::TokenBucket::Take(double amount)
+{
+    if (_rate != 0)
+    {
+        _tokens -= amount;
+    }
+}
+
+void IoScheduler::TokenBucket::refill(Clock::time_point now)
+{
+    if (_rate != 0)
+    {
+        auto burst = std::max(1.0, static_cast<double>(_rate) * std::chrono::duration<double>(BurstDuration).count());
+        _tokens = std::min(burst, _tokens + static_cast<double>(_rate) * std::chrono::duration<double>(now - _refilled).count());
+    }
+    _refilled = now;
+}
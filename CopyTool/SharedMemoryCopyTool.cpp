@@ -1,22 +1,70 @@
-#include "include/CopyTool/ICopyTool.h"
+#include "include/CopyTool/CopyEngine.h"
+#include "include/CopyTool/FramedCompression.h"
 
-#include <boost/interprocess/shared_memory_object.hpp>
-#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
 #include <boost/interprocess/sync/interprocess_mutex.hpp>
 #include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
-#include <array>
 #include <atomic>
+#include <cerrno>
 #include <chrono>
-#include <fstream>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <variant>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
 
 using namespace boost::interprocess;
 
+std::int64_t CurrentProcessId()
+{
+#ifdef _WIN32
+    return static_cast<std::int64_t>(::GetCurrentProcessId());
+#else
+    return static_cast<std::int64_t>(::getpid());
+#endif
+}
+
+// A peer killed in the middle of the copy leaves its id behind in the segment.
+bool IsProcessAlive(std::int64_t processId)
+{
+#ifdef _WIN32
+    auto process = ::OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(processId));
+    if (!process)
+    {
+        return false;
+    }
+    auto alive = ::WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    ::CloseHandle(process);
+    return alive;
+#else
+    return ::kill(static_cast<pid_t>(processId), 0) == 0 || errno == EPERM;
+#endif
+}
+
 class SharedMemory
 {
 public:
+    // How the reader copies the current source. The writer waits for it before touching the destination.
+    enum class CopyPath
+    {
+        Undecided,
+        // The reader copied a small file on its own.
+        SmallFile,
+        Relay
+    };
+
     struct SharedData
     {
         std::chrono::steady_clock::time_point _readerStart;
@@ -24,40 +72,57 @@ public:
         interprocess_mutex _mutex1;
         interprocess_mutex _mutex2;
         interprocess_condition _cond;
+        interprocess_condition _firstBufferCond;
+        interprocess_condition _secondBufferCond;
         std::atomic<bool> _firstBufferReady = false;
         std::atomic<bool> _secondBufferReady = false;
         std::atomic<std::size_t> _actualFirstBufferSize;
         std::atomic<std::size_t> _actualSecondBufferSize;
-        std::array<char, 1024> _firstBuffer;
-        std::array<char, 1024> _secondBuffer;
         std::atomic<bool> _readingFinished = false;
+        std::atomic<bool> _writingFinished = false;
         std::atomic<std::size_t> _copyToolNumber = 0;
         std::atomic<bool> _readerTerminated = false;
+        std::atomic<CopyPath> _copyPath = CopyPath::Undecided;
+        std::atomic<std::int64_t> _readerProcessId = 0;
+        std::atomic<std::int64_t> _writerProcessId = 0;
     };
 
-    explicit SharedMemory(std::string_view sharedMemoryName)
-        : _sharedMemoryName{sharedMemoryName}
+    SharedMemory(std::string_view sharedMemoryName, std::size_t slotSize)
+        : _sharedMemoryName{sharedMemoryName},
+          _segment{open_or_create, _sharedMemoryName.c_str(), sizeof(SharedData) + 2 * checkedSlotSize(slotSize) + SegmentOverhead}
     {
-        _shm_obj = shared_memory_object(open_or_create, _sharedMemoryName.data(), read_write);
-        _shm_obj.truncate(sizeof(SharedData));
-        _region = mapped_region(_shm_obj, read_write);
-        _sharedData = static_cast<SharedData *>(_region.get_address());
-        _sharedData->_copyToolNumber += 1;
-        if (_sharedData->_copyToolNumber == 1)
+        // Constructing the objects in place makes the mutexes and the condition process-shared;
+        // the managed segment serializes construction between the two processes.
+        _sharedData = _segment.find_or_construct<SharedData>("SharedData")();
+        _firstBuffer = {_segment.find_or_construct<char>("FirstBuffer")[slotSize](), slotSize};
+        _secondBuffer = {_segment.find_or_construct<char>("SecondBuffer")[slotSize](), slotSize};
+        if (_segment.find<char>("FirstBuffer").second != slotSize)
+        {
+            throw std::runtime_error("Shared memory " + _sharedMemoryName + " uses a different slot size");
+        }
+        _instanceNumber = ++_sharedData->_copyToolNumber;
+        if (_instanceNumber == 1)
         {
             _sharedData->_firstBufferReady = false;
             _sharedData->_secondBufferReady = false;
             _sharedData->_readingFinished = false;
+            _sharedData->_writingFinished = false;
+            _sharedData->_readerTerminated = false;
+            _sharedData->_copyPath = CopyPath::Undecided;
+            _sharedData->_readerProcessId = CurrentProcessId();
+        }
+        else if (_instanceNumber == 2)
+        {
+            _sharedData->_writerProcessId = CurrentProcessId();
         }
         std::cout << "Shared memory object constructed" << std::endl;
     }
 
     ~SharedMemory()
     {
-        _sharedData->_copyToolNumber -= 1;
-        if (_sharedData->_copyToolNumber == 0)
+        if (--_sharedData->_copyToolNumber == 0)
         {
-            shared_memory_object::remove(_sharedMemoryName.data());
+            shared_memory_object::remove(_sharedMemoryName.c_str());
             std::cout << "Shared memory removed" << std::endl;
         }
         std::cout << "Shared memory object destructed" << std::endl;
@@ -68,59 +133,127 @@ public:
         return *_sharedData;
     }
 
+    // Order in which this process attached to the segment, starting from 1.
+    std::size_t getInstanceNumber() const
+    {
+        return _instanceNumber;
+    }
+
+    std::span<char> getFirstBuffer()
+    {
+        return _firstBuffer;
+    }
+
+    std::span<char> getSecondBuffer()
+    {
+        return _secondBuffer;
+    }
+
 private:
-    std::string_view _sharedMemoryName;
-    shared_memory_object _shm_obj;
-    mapped_region _region;
+    static constexpr std::size_t SegmentOverhead = 64 * 1024;
+
+    // An empty slot never reads to the end of the source, so the relay would not finish.
+    static std::size_t checkedSlotSize(std::size_t slotSize)
+    {
+        if (slotSize == 0)
+        {
+            throw std::invalid_argument("Shared memory slot size must not be 0");
+        }
+        return slotSize;
+    }
+
+    std::string _sharedMemoryName;
+    managed_shared_memory _segment;
     SharedData *_sharedData;
+    std::size_t _instanceNumber;
+    std::span<char> _firstBuffer;
+    std::span<char> _secondBuffer;
 };
 
 class File
 {
 public:
-    File(const std::filesystem::path &path, std::ios_base::openmode mode)
-        : _file{path, mode}
+    File(const std::filesystem::path &path, const CompressionOptions &compression, IoPriority priority)
+        : _priority{priority}
+    {
+        if (compression._mode == CompressionMode::Decompress)
+        {
+            _source.emplace<DecompressingSource<NativeSource>>().Open(path);
+        }
+        else
+        {
+            _source.emplace<NativeSource>().Open(path);
+        }
+        std::cout << "File " << path << " constructed" << std::endl;
+    }
+
+    File(const std::filesystem::path &path, std::uintmax_t size, const WritebackOptions &writeback,
+         const CompressionOptions &compression, IoPriority priority)
+        : _priority{priority}
     {
-        if (!_file.is_open())
+        if (compression._mode == CompressionMode::Compress)
+        {
+            _sink.emplace<CompressingSink<NativeSink>>(compression).Open(path, size, writeback);
+        }
+        else
         {
-            throw std::runtime_error("Error: Couldn't open file " + path.string());
+            _sink.emplace<NativeSink>().Open(path, size, writeback);
         }
         std::cout << "File " << path << " constructed" << std::endl;
     }
-    template <class BufferT>
-    auto Read(BufferT &buffer, std::size_t size)
+
+    std::size_t Read(std::span<char> buffer, std::size_t size)
     {
-        _file.read(buffer.data(), size);
-        return _file.gcount();
+        auto length = std::visit([&](auto &source) -> std::size_t
+                                 {
+            if constexpr (std::is_same_v<std::decay_t<decltype(source)>, std::monostate>)
+            {
+                throw std::logic_error("File is not opened for reading");
+            }
+            else
+            {
+                return ScheduledRead(source, buffer.data(), size, _priority);
+            } }, _source);
+        _eof = length < size;
+        return length;
     }
 
-    template <class BufferT>
-    void Write(BufferT &buffer, std::size_t size)
+    void Write(std::span<const char> buffer, std::size_t size)
     {
-        _file.write(buffer.data(), size);
+        std::visit([&](auto &sink)
+                   {
+            if constexpr (!std::is_same_v<std::decay_t<decltype(sink)>, std::monostate>)
+            {
+                ScheduledWrite(sink, buffer.data(), size, _priority);
+            } }, _sink);
     }
 
-    bool Eof() const
+    // Finishes writing, including the final sync requested by the writeback options.
+    void Close()
     {
-        return _file.eof();
+        std::visit([](auto &sink)
+                   {
+            if constexpr (!std::is_same_v<std::decay_t<decltype(sink)>, std::monostate>)
+            {
+                sink.Close();
+            } }, _sink);
     }
 
-    explicit operator bool() const
+    bool Eof() const
     {
-        return static_cast<bool>(_file);
+        return _eof;
     }
 
     ~File()
     {
-        if (_file.is_open())
-        {
-            _file.close();
-        }
         std::cout << "File destructed" << std::endl;
     }
 
 private:
-    std::fstream _file;
+    std::variant<std::monostate, NativeSource, DecompressingSource<NativeSource>> _source;
+    std::variant<std::monostate, NativeSink, CompressingSink<NativeSink>> _sink;
+    IoPriority _priority;
+    bool _eof = false;
 };
 
 void ThrowFictiveException()
@@ -131,31 +264,75 @@ void ThrowFictiveException()
 class SharedMemoryCopyTool : public ICopyTool
 {
 public:
-    SharedMemoryCopyTool(std::string_view sharedMemoryName)
-        : _sharedMemory{std::make_unique<SharedMemory>(sharedMemoryName)}
+    SharedMemoryCopyTool(std::string_view sharedMemoryName, SharedMemoryOptions options)
+        : _sharedMemory{std::make_unique<SharedMemory>(sharedMemoryName, options._slotSize)},
+          _options{options}
     {
-        _mode = (_sharedMemory->getData()._copyToolNumber == 1) ? CopyToolMode::Reader : CopyToolMode::Writer;
+        _mode = (_sharedMemory->getInstanceNumber() == 1) ? CopyToolMode::Reader : CopyToolMode::Writer;
         std::cout << "Shared memory copy tool constructed. Mode: "
                   << (_mode == CopyToolMode::Reader ? "Reader. " : "Writer. ")
-                  << "Instance number: " << _sharedMemory->getData()._copyToolNumber << std::endl;
+                  << "Instance number: " << _sharedMemory->getInstanceNumber() << std::endl;
     }
 
     void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination)
     {
-        if (_sharedMemory->getData()._copyToolNumber > 2)
+        if (_sharedMemory->getInstanceNumber() > 2)
         {
             std::cout << "It is extra writer. Nothing to do" << std::endl;
         }
         else if (CopyToolMode::Reader == _mode)
         {
-            _file = std::make_unique<File>(source, std::ios::binary | std::ios::in);
-            Read();
+            // The first process of a pair is the one that always runs, so it copies small files on its own.
+            if (smallFileCopy())
+            {
+                if (auto length = TryCopySmallFile(source, destination, std::min(_options._slotSize, SmallFileLimit),
+                                                   _options._writeback, _options._priority))
+                {
+                    publishCopyPath(SharedMemory::CopyPath::SmallFile);
+                    _readingCompleted = true;
+                    std::cout << "Processed data length: " << *length << std::endl;
+                    return;
+                }
+            }
+            publishCopyPath(SharedMemory::CopyPath::Relay);
+            try
+            {
+                _file = std::make_unique<File>(source, _options._compression, _options._priority);
+                Read();
+            }
+            catch (...)
+            {
+                // A writer killed in the middle of the copy cannot remove its partial destination.
+                std::filesystem::remove(destination);
+                throw;
+            }
         }
         else
         {
+            // The writer follows the reader's decision, so both agree even if the source changes meanwhile.
+            auto copyPath = waitForCopyPath();
+            if (copyPath == SharedMemory::CopyPath::Undecided)
+            {
+                throw std::runtime_error("Writer timed out waiting for the reader to start");
+            }
+            if (copyPath == SharedMemory::CopyPath::SmallFile)
+            {
+                std::cout << "Reader copied the small file on its own. Nothing to do" << std::endl;
+                return;
+            }
             std::filesystem::remove(destination);
-            _file = std::make_unique<File>(destination, std::ios::binary | std::ios::out);
-            Write();
+            try
+            {
+                _file = std::make_unique<File>(destination, contentSize(source), _options._writeback, _options._compression, _options._priority);
+                Write();
+            }
+            catch (...)
+            {
+                // A failed copy must not leave a truncated destination that passes for a complete one.
+                _file.reset();
+                std::filesystem::remove(destination);
+                throw;
+            }
         }
     }
 
@@ -163,10 +340,17 @@ public:
     {
         if (_mode == CopyToolMode::Reader)
         {
-            boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock1(_sharedMemory->getData()._mutex1);
-            boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock2(_sharedMemory->getData()._mutex2);
+            // Bounded, as a writer killed while holding a slot lock never releases it; the writer polls the flags anyway.
+            Lock lock1(_sharedMemory->getData()._mutex1, pollDeadline());
+            Lock lock2(_sharedMemory->getData()._mutex2, pollDeadline());
+            if (!_readingCompleted)
+            {
+                // Otherwise the writer would take the early exit for the end of the source and keep a truncated file.
+                _sharedMemory->getData()._readerTerminated = true;
+            }
             _sharedMemory->getData()._readingFinished = true;
-            _sharedMemory->getData()._cond.notify_one();
+            _sharedMemory->getData()._firstBufferCond.notify_one();
+            _sharedMemory->getData()._secondBufferCond.notify_one();
         }
         std::cout << "Shared memory copy tool destroed" << std::endl;
     }
@@ -178,158 +362,248 @@ private:
         Writer
     };
 
-    void Write()
+    using Lock = boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>;
+
+    static constexpr auto PeerPollInterval = boost::posix_time::milliseconds(100);
+
+    static boost::posix_time::ptime pollDeadline()
     {
-        try
+        return boost::posix_time::microsec_clock::universal_time() + PeerPollInterval;
+    }
+
+    void checkPeer() const
+    {
+        auto &data = _sharedMemory->getData();
+        auto peerProcessId = _mode == CopyToolMode::Reader ? data._writerProcessId.load() : data._readerProcessId.load();
+        if (peerProcessId != 0 && !IsProcessAlive(peerProcessId))
+        {
+            throw std::runtime_error(std::string(_mode == CopyToolMode::Reader ? "Writer" : "Reader") +
+                                     " process exited in the middle of the copy");
+        }
+    }
+
+    // Lock and wait in short slices, so a killed peer is noticed instead of waited for forever.
+    Lock lockSlot(interprocess_mutex &mutex) const
+    {
+        Lock lock(mutex, defer_lock);
+        while (!lock.timed_lock(pollDeadline()))
         {
-            auto writerStart = std::chrono::steady_clock::now();
-            _sharedMemory->getData()._cond.notify_one();
-            std::size_t processedDataLength = 0;
-            while (true)
+            checkPeer();
+        }
+        return lock;
+    }
+
+    template <typename Predicate>
+    void waitSlot(Lock &lock, interprocess_condition &cond, Predicate predicate) const
+    {
+        while (!predicate())
+        {
+            if (!cond.timed_wait(lock, pollDeadline()))
             {
-                {
-                    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock1(_sharedMemory->getData()._mutex1);
-                    while (!_sharedMemory->getData()._firstBufferReady && !_sharedMemory->getData()._readingFinished)
-                    {
-                        _sharedMemory->getData()._cond.wait(lock1);
-                    }
-
-                    if (_sharedMemory->getData()._readingFinished && !_sharedMemory->getData()._firstBufferReady)
-                    {
-                        std::cout << "Reading finished" << std::endl;
-                        break;
-                    }
-
-                    _file->Write(_sharedMemory->getData()._firstBuffer, _sharedMemory->getData()._actualFirstBufferSize);
-                    processedDataLength += _sharedMemory->getData()._actualFirstBufferSize;
-                    _sharedMemory->getData()._firstBufferReady = false;
-                    _sharedMemory->getData()._cond.notify_one();
-                    std::cout << "First buffer written" << std::endl;
-                }
-                {
-                    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock2(_sharedMemory->getData()._mutex2);
-                    while (!_sharedMemory->getData()._secondBufferReady && !_sharedMemory->getData()._readingFinished)
-                    {
-                        _sharedMemory->getData()._cond.wait(lock2);
-                        std::cout << "1" << std::endl;
-                    }
-                    if (_sharedMemory->getData()._readingFinished && !_sharedMemory->getData()._secondBufferReady)
-                    {
-                        break;
-                    }
-
-                    _file->Write(_sharedMemory->getData()._secondBuffer, _sharedMemory->getData()._actualSecondBufferSize);
-                    processedDataLength += _sharedMemory->getData()._actualSecondBufferSize;
-                    _sharedMemory->getData()._secondBufferReady = false;
-                    _sharedMemory->getData()._cond.notify_one();
-                }
+                checkPeer();
             }
-            auto writerFinish = std::chrono::steady_clock::now();
-            std::cout << "Expecting writer time: "
-                      << std::chrono::duration_cast<std::chrono::nanoseconds>(
-                             writerStart - _sharedMemory->getData()._readerStart)
-                             .count()
-                      << " nanoseconds." << std::endl;
-            std::cout << "Writer work time: "
-                      << std::chrono::duration_cast<std::chrono::nanoseconds>(
-                             writerFinish - writerStart)
-                             .count()
-                      << " nanoseconds." << std::endl;
-            std::cout << "General work time: "
-                      << std::chrono::duration_cast<std::chrono::nanoseconds>(
-                             writerFinish - _sharedMemory->getData()._readerStart)
-                             .count()
-                      << " nanoseconds." << std::endl;
-            std::cout << "Processed data length: " << processedDataLength << std::endl;
         }
-        catch (const std::runtime_error &err)
+    }
+
+    // The slot is read into outside of its lock, so the writer can drain the other slot meanwhile.
+    std::size_t fillSlot(interprocess_mutex &mutex, interprocess_condition &cond, std::atomic<bool> &ready,
+                         std::atomic<std::size_t> &actualSize, std::span<char> buffer)
+    {
         {
-            std::cout << err.what() << std::endl;
+            auto lock = lockSlot(mutex);
+            waitSlot(lock, cond, [&]
+                     { return !ready; });
         }
+        auto length = _file->Read(buffer, buffer.size());
+        auto lock = lockSlot(mutex);
+        actualSize = length;
+        ready = true;
+        cond.notify_one();
+        return length;
     }
 
-    void Read()
+    // Empty once the reader has finished and the slot holds nothing more.
+    std::optional<std::size_t> drainSlot(interprocess_mutex &mutex, interprocess_condition &cond, std::atomic<bool> &ready,
+                                         std::atomic<std::size_t> &actualSize, std::span<const char> buffer)
     {
-        try
         {
-            _sharedMemory->getData()._readerStart = std::chrono::steady_clock::now();
-            std::cout << "Waiting for writer" << std::endl;
+            auto lock = lockSlot(mutex);
+            waitSlot(lock, cond, [&]
+                     { return ready || _sharedMemory->getData()._readingFinished; });
+            if (!ready)
             {
-                boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(_sharedMemory->getData()._mutex1);
-                if (!_sharedMemory->getData()._cond.wait_for(lock, std::chrono::seconds(5), [this]
-                                                             { return _sharedMemory->getData()._copyToolNumber == 2; }))
-                {
-                    // If wait_for returns false, the writer did not start within 5 seconds
-                    std::cout << "Reader timed out waiting for the writer to start. Nothing to do." << std::endl;
-                    return;
-                }
-                else
+                if (_sharedMemory->getData()._readerTerminated)
                 {
-                    std::cout << "Reader starts processing as writer has started." << std::endl;
+                    throw std::runtime_error("Reader stopped before the end of the source");
                 }
+                return std::nullopt;
             }
-            std::size_t processedDataLength = 0;
-            while (*_file)
+        }
+        std::size_t length = actualSize;
+        _file->Write(buffer, length);
+        auto lock = lockSlot(mutex);
+        ready = false;
+        cond.notify_one();
+        return length;
+    }
+
+    // The injected failure exercises the relay, which small files would skip.
+    bool smallFileCopy() const
+    {
+        return _options._smallFileCopy && _options._compression._mode == CompressionMode::None && !_options._injectFailure;
+    }
+
+    void publishCopyPath(SharedMemory::CopyPath copyPath)
+    {
+        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(_sharedMemory->getData()._mutex1);
+        _sharedMemory->getData()._copyPath = copyPath;
+        _sharedMemory->getData()._cond.notify_all();
+    }
+
+    // Undecided when the reader does not get to the copy within 5 seconds.
+    SharedMemory::CopyPath waitForCopyPath()
+    {
+        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(_sharedMemory->getData()._mutex1);
+        _sharedMemory->getData()._cond.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::seconds(5), [this]
+                                                  { return _sharedMemory->getData()._copyPath != SharedMemory::CopyPath::Undecided; });
+        return _sharedMemory->getData()._copyPath;
+    }
+
+    // Size of what the reader relays, used to preallocate the destination; 0 when it is unknown.
+    std::uintmax_t contentSize(const std::filesystem::path &source) const
+    {
+        try
+        {
+            if (_options._compression._mode == CompressionMode::Decompress)
             {
-                // ThrowFictiveException();
-                // Handle the first buffer
-                if (!_sharedMemory->getData()._firstBufferReady && !_file->Eof())
-                {
-                    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock1(_sharedMemory->getData()._mutex1);
-                    if (!_sharedMemory->getData()._firstBufferReady && !_file->Eof())
-                    { // Double-check locking
-                        _sharedMemory->getData()._actualFirstBufferSize =
-                            _file->Read(_sharedMemory->getData()._firstBuffer,
-                                        _sharedMemory->getData()._firstBuffer.size());
-                        processedDataLength += _sharedMemory->getData()._actualFirstBufferSize;
-                        _sharedMemory->getData()._firstBufferReady = true;
-                        _sharedMemory->getData()._cond.notify_one();
-                    }
-                }
-                ThrowFictiveException();
+                return FramedFileReader(source).Size();
+            }
+            return std::filesystem::file_size(source);
+        }
+        catch (const std::exception &)
+        {
+            return 0;
+        }
+    }
 
-                // Handle the second buffer
-                if (!_sharedMemory->getData()._secondBufferReady && !_file->Eof())
-                {
-                    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock2(_sharedMemory->getData()._mutex2);
-                    if (!_sharedMemory->getData()._secondBufferReady && !_file->Eof())
-                    { // Double-check locking
-                        _sharedMemory->getData()._actualSecondBufferSize =
-                            _file->Read(_sharedMemory->getData()._secondBuffer,
-                                        _sharedMemory->getData()._secondBuffer.size());
-                        processedDataLength += _sharedMemory->getData()._actualSecondBufferSize;
-                        _sharedMemory->getData()._secondBufferReady = true;
-                        _sharedMemory->getData()._cond.notify_one();
-                    }
-                }
+    void Write()
+    {
+        auto writerStart = std::chrono::steady_clock::now();
+        _sharedMemory->getData()._cond.notify_one();
+        std::size_t processedDataLength = 0;
+        auto &data = _sharedMemory->getData();
+        while (true)
+        {
+            auto length = drainSlot(data._mutex1, data._firstBufferCond, data._firstBufferReady,
+                                    data._actualFirstBufferSize, _sharedMemory->getFirstBuffer());
+            if (!length)
+            {
+                std::cout << "Reading finished" << std::endl;
+                break;
+            }
+            processedDataLength += *length;
+            length = drainSlot(data._mutex2, data._secondBufferCond, data._secondBufferReady,
+                               data._actualSecondBufferSize, _sharedMemory->getSecondBuffer());
+            if (!length)
+            {
+                break;
             }
+            processedDataLength += *length;
+        }
+        _file->Close();
+        {
+            auto lock = lockSlot(data._mutex1);
+            data._writingFinished = true;
+            data._firstBufferCond.notify_one();
+        }
+        auto writerFinish = std::chrono::steady_clock::now();
+        std::cout << "Expecting writer time: "
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         writerStart - _sharedMemory->getData()._readerStart)
+                         .count()
+                  << " nanoseconds." << std::endl;
+        std::cout << "Writer work time: "
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         writerFinish - writerStart)
+                         .count()
+                  << " nanoseconds." << std::endl;
+        std::cout << "General work time: "
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         writerFinish - _sharedMemory->getData()._readerStart)
+                         .count()
+                  << " nanoseconds." << std::endl;
+        std::cout << "Processed data length: " << processedDataLength << std::endl;
+    }
 
+    void Read()
+    {
+        _sharedMemory->getData()._readerStart = std::chrono::steady_clock::now();
+        std::cout << "Waiting for writer" << std::endl;
+        {
+            boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(_sharedMemory->getData()._mutex1);
+            if (!_sharedMemory->getData()._cond.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::seconds(5), [this]
+                                                         { return _sharedMemory->getData()._copyToolNumber >= 2; }))
+            {
+                // If timed_wait returns false, the writer did not start within 5 seconds
+                std::cout << "Reader timed out waiting for the writer to start. Nothing to do." << std::endl;
+                return;
+            }
+            else
+            {
+                std::cout << "Reader starts processing as writer has started." << std::endl;
+            }
+        }
+        std::size_t processedDataLength = 0;
+        // The writer drains the buffers strictly in turn, so the reader fills them in the same order.
+        auto &data = _sharedMemory->getData();
+        while (!_file->Eof())
+        {
+            processedDataLength += fillSlot(data._mutex1, data._firstBufferCond, data._firstBufferReady,
+                                            data._actualFirstBufferSize, _sharedMemory->getFirstBuffer());
+            if (_options._injectFailure)
             {
-                boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock1(_sharedMemory->getData()._mutex1);
-                boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock2(_sharedMemory->getData()._mutex2);
-                _sharedMemory->getData()._readingFinished = true;
-                _sharedMemory->getData()._cond.notify_one();
+                ThrowFictiveException();
             }
+            if (_file->Eof())
+            {
+                break;
+            }
+            processedDataLength += fillSlot(data._mutex2, data._secondBufferCond, data._secondBufferReady,
+                                            data._actualSecondBufferSize, _sharedMemory->getSecondBuffer());
+        }
 
-            std::cout << "Reader work time: "
-                      << std::chrono::duration_cast<std::chrono::nanoseconds>(
-                             std::chrono::steady_clock::now() -
-                             _sharedMemory->getData()._readerStart)
-                             .count()
-                      << " nanoseconds." << std::endl;
-            std::cout << "Processed data length: " << processedDataLength << std::endl;
+        {
+            auto lock1 = lockSlot(data._mutex1);
+            auto lock2 = lockSlot(data._mutex2);
+            _readingCompleted = true;
+            data._readingFinished = true;
+            data._firstBufferCond.notify_one();
+            data._secondBufferCond.notify_one();
         }
-        catch (const std::runtime_error &err)
+        // The copy only succeeded once the writer has closed the destination, so a writer that dies
+        // while draining the last slots fails the reader too.
         {
-            std::cout << "Exception: " << err.what() << std::endl;
+            auto lock = lockSlot(data._mutex1);
+            waitSlot(lock, data._firstBufferCond, [&]
+                     { return data._writingFinished.load(); });
         }
+
+        std::cout << "Reader work time: "
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() -
+                         _sharedMemory->getData()._readerStart)
+                         .count()
+                  << " nanoseconds." << std::endl;
+        std::cout << "Processed data length: " << processedDataLength << std::endl;
     }
     std::unique_ptr<SharedMemory> _sharedMemory;
     std::unique_ptr<File> _file;
+    SharedMemoryOptions _options;
     CopyToolMode _mode;
+    bool _readingCompleted = false;
 };
 
-ICopyToolPtrU CreateSharedMemoryCopyTool(std::string_view sharedMemoryName)
+ICopyToolPtrU CreateSharedMemoryCopyTool(std::string_view sharedMemoryName, SharedMemoryOptions options)
 {
-    return std::make_unique<SharedMemoryCopyTool>(sharedMemoryName);
+    return std::make_unique<SharedMemoryCopyTool>(sharedMemoryName, options);
 }
@@ -0,0 +1,167 @@
+#include "include/CopyTool/CopyEngine.h"
+
+#ifndef _WIN32
+namespace
+{
+    // Size of source when it is a regular file of at most limit bytes.
+    std::optional<std::uintmax_t> SmallFileSize(const std::filesystem::path &source, std::size_t limit)
+    {
+#ifdef __linux__
+        struct statx status;
+        if (::statx(AT_FDCWD, source.c_str(), 0, STATX_TYPE | STATX_SIZE, &status) != 0 || !S_ISREG(status.stx_mode) ||
+            status.stx_size > limit)
+        {
+            return std::nullopt;
+        }
+        return status.stx_size;
+#else
+        struct stat status;
+        if (::stat(source.c_str(), &status) != 0 || !S_ISREG(status.st_mode) || static_cast<std::uintmax_t>(status.st_size) > limit)
+        {
+            return std::nullopt;
+        }
+        return static_cast<std::uintmax_t>(status.st_size);
+#endif
+    }
+
+    // Grows only, so a thread copying many small files allocates once.
+    char *SmallFileBuffer(std::size_t size)
+    {
+        thread_local auto buffer = std::unique_ptr<char[]>();
+        thread_local auto capacity = std::size_t{0};
+        if (capacity < size)
+        {
+            buffer = std::make_unique_for_overwrite<char[]>(size);
+            capacity = size;
+        }
+        return buffer.get();
+    }
+}
+
+std::optional<std::uintmax_t> TryCopySmallFile(const std::filesystem::path &source,
+                                               const std::filesystem::path &destination,
+                                               std::size_t limit,
+                                               const WritebackOptions &writeback,
+                                               IoPriority priority)
+{
+    auto size = SmallFileSize(source, limit);
+    if (!size)
+    {
+        return std::nullopt;
+    }
+    auto sourceFile = FileDescriptor(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+    if (sourceFile.Get() < 0)
+    {
+        throw std::runtime_error("File " + source.generic_string() + " cannot be opened for reading");
+    }
+
+    // One byte more than statx reported shows that the file has grown since.
+    auto capacity = static_cast<std::size_t>(*size) + 1;
+    auto buffer = SmallFileBuffer(capacity);
+    auto length = std::size_t{0};
+    {
+        auto io = ScheduledIo(priority, static_cast<std::size_t>(*size));
+        auto result = ssize_t{0};
+        do
+        {
+            result = ::read(sourceFile.Get(), buffer + length, capacity - length);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("File " + source.generic_string() + " cannot be read");
+            }
+            length += static_cast<std::size_t>(result);
+        } while (result != 0 && length < *size);
+    }
+    if (length > *size)
+    {
+        return std::nullopt;
+    }
+
+    std::filesystem::remove(destination);
+    auto destinationFile = FileDescriptor(::open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644));
+    if (destinationFile.Get() < 0)
+    {
+        throw std::runtime_error("File " + destination.generic_string() + " cannot be opened for writing");
+    }
+    {
+        auto io = ScheduledIo(priority, length);
+        for (std::size_t written = 0; written < length;)
+        {
+            auto result = ::write(destinationFile.Get(), buffer + written, length - written);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("File " + destination.generic_string() + " cannot be written");
+            }
+            written += static_cast<std::size_t>(result);
+        }
+    }
+    if (writeback._durability != Durability::None && ::fdatasync(destinationFile.Get()) != 0)
+    {
+        throw std::runtime_error("Written data cannot be synchronized to the disk");
+    }
+    if (!destinationFile.Close())
+    {
+        throw std::runtime_error("File " + destination.generic_string() + " cannot be written");
+    }
+    return length;
+}
+#else
+std::optional<std::uintmax_t> TryCopySmallFile(const std::filesystem::path & /*source*/,
+                                               const std::filesystem::path & /*destination*/,
+                                               std::size_t /*limit*/,
+                                               const WritebackOptions & /*writeback*/,
+                                               IoPriority /*priority*/)
+{
+    return std::nullopt;
+}
+#endif
+
+namespace
+{
+    class SmallFileCopyTool : public ICopyTool
+    {
+    public:
+        SmallFileCopyTool(ICopyToolPtrU copyTool, std::size_t limit, WritebackOptions writeback, IoPriority priority)
+            : _copyTool{std::move(copyTool)},
+              _limit{limit},
+              _writeback{writeback},
+              _priority{priority}
+        {
+        }
+
+        void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination) override
+        {
+            if (!TryCopySmallFile(source, destination, _limit, _writeback, _priority))
+            {
+                _copyTool->CopyFile(source, destination);
+            }
+        }
+
+        std::future<void> CopyFileAsync(const std::filesystem::path &source,
+                                        const std::filesystem::path &destination,
+                                        CopyProgressCallback progress,
+                                        std::stop_token stopToken) override
+        {
+            return _copyTool->CopyFileAsync(source, destination, std::move(progress), std::move(stopToken));
+        }
+
+    private:
+        ICopyToolPtrU _copyTool;
+        std::size_t _limit;
+        WritebackOptions _writeback;
+        IoPriority _priority;
+    };
+}
+
+ICopyToolPtrU CreateSmallFileCopyTool(ICopyToolPtrU copyTool, std::size_t limit, WritebackOptions writeback, IoPriority priority)
+{
+    return std::make_unique<SmallFileCopyTool>(std::move(copyTool), limit, writeback, priority);
+}
@@ -1,16 +1,40 @@
-#include "include/CopyTool/ICopyTool.h"
+#include "include/CopyTool/CopyEngine.h"
 
 class StlCopyTool : public ICopyTool
 {
 public:
+    explicit StlCopyTool(IoPriority priority)
+        : _throttledCopyTool{std::make_unique<CopyEngine<NativeSource, NativeSink, InlineHandoff>>(ThrottledChunkSize, WritebackOptions{},
+                                                                                                  CompressionOptions{}, priority)}
+    {
+    }
+
     void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination) override
     {
+        // copy_file runs as one opaque call the scheduler cannot pace, so throttled copies go chunk by chunk.
+        if (isThrottled())
+        {
+            _throttledCopyTool->CopyFile(source, destination);
+            return;
+        }
         std::filesystem::remove(destination);
         std::filesystem::copy_file(source, destination);
     }
+
+private:
+    static constexpr std::size_t ThrottledChunkSize = 1024 * 1024;
+
+    static bool isThrottled()
+    {
+        auto &scheduler = IoScheduler::Instance();
+        auto limits = scheduler.GetLimits();
+        return limits._bytesPerSecond != 0 || limits._operationsPerSecond != 0 || scheduler.TracksLatency();
+    }
+
+    ICopyToolPtrU _throttledCopyTool;
 };
 
-ICopyToolPtrU CreateStlCopyTool()
+ICopyToolPtrU CreateStlCopyTool(IoPriority priority)
 {
-    return std::make_unique<StlCopyTool>();
-}
\ No newline at end of file
+    return CreateSmallFileCopyTool(std::make_unique<StlCopyTool>(priority), SmallFileLimit, WritebackOptions{}, priority);
+}
@@ -0,0 +1,809 @@
+#pragma once
+#include "ICopyTool.h"
+#include "IoScheduler.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Source policies open a file and read it sequentially. Read returns 0 at the end of the file.
+class FstreamSource
+{
+public:
+    void Open(const std::filesystem::path &path)
+    {
+        _file.open(path, std::ios::binary);
+        if (!_file)
+        {
+            throw std::runtime_error("File " + path.generic_string() + " cannot be opened for reading");
+        }
+        _size = std::filesystem::file_size(path);
+    }
+
+    std::size_t Read(char *data, std::size_t size)
+    {
+        _file.read(data, size);
+        return static_cast<std::size_t>(_file.gcount());
+    }
+
+    std::uintmax_t Size() const
+    {
+        return _size;
+    }
+
+private:
+    std::ifstream _file;
+    std::uintmax_t _size = 0;
+};
+
+class MmapSource
+{
+public:
+    void Open(const std::filesystem::path &path)
+    {
+        _size = std::filesystem::file_size(path);
+        if (_size == 0)
+        {
+            return;
+        }
+        try
+        {
+            _mapping = boost::interprocess::file_mapping(path.string().c_str(), boost::interprocess::read_only);
+            _region = boost::interprocess::mapped_region(_mapping, boost::interprocess::read_only);
+        }
+        catch (const boost::interprocess::interprocess_exception &)
+        {
+            throw std::runtime_error("File " + path.generic_string() + " cannot be opened for reading");
+        }
+        _region.advise(boost::interprocess::mapped_region::advice_sequential);
+    }
+
+    std::size_t Read(char *data, std::size_t size)
+    {
+        auto length = static_cast<std::size_t>(std::min<std::uintmax_t>(size, _size - _offset));
+        std::memcpy(data, static_cast<const char *>(_region.get_address()) + _offset, length);
+        _offset += length;
+        return length;
+    }
+
+    std::uintmax_t Size() const
+    {
+        return _size;
+    }
+
+private:
+    boost::interprocess::file_mapping _mapping;
+    boost::interprocess::mapped_region _region;
+    std::uintmax_t _size = 0;
+    std::uintmax_t _offset = 0;
+};
+
+// Sink policies create the destination, which must not exist, and get the final size up front.
+// Sinks without access to a descriptor ignore the writeback options.
+class FstreamSink
+{
+public:
+    void Open(const std::filesystem::path &path, std::uintmax_t /*size*/, const WritebackOptions & /*writeback*/)
+    {
+        _path = path;
+        _file.open(path, std::ios::binary);
+        if (!_file)
+        {
+            throw std::runtime_error("File " + path.generic_string() + " cannot be opened for writing");
+        }
+    }
+
+    void Write(const char *data, std::size_t size)
+    {
+        _file.write(data, size);
+    }
+
+    void Close()
+    {
+        _file.close();
+        if (!_file)
+        {
+            throw std::runtime_error("File " + _path.generic_string() + " cannot be written");
+        }
+    }
+
+private:
+    std::filesystem::path _path;
+    std::ofstream _file;
+};
+
+class MmapSink
+{
+public:
+    void Open(const std::filesystem::path &path, std::uintmax_t size, const WritebackOptions &writeback)
+    {
+        _durability = writeback._durability;
+        if (!std::ofstream(path, std::ios::binary))
+        {
+            throw std::runtime_error("File " + path.generic_string() + " cannot be opened for writing");
+        }
+        if (size == 0)
+        {
+            return;
+        }
+        std::filesystem::resize_file(path, size);
+        _mapping = boost::interprocess::file_mapping(path.string().c_str(), boost::interprocess::read_write);
+        _region = boost::interprocess::mapped_region(_mapping, boost::interprocess::read_write);
+    }
+
+    void Write(const char *data, std::size_t size)
+    {
+        if (_offset + size > _region.get_size())
+        {
+            throw std::runtime_error("Source has grown beyond the mapped destination");
+        }
+        std::memcpy(static_cast<char *>(_region.get_address()) + _offset, data, size);
+        _offset += size;
+    }
+
+    void Close()
+    {
+        if (_region.get_size() != 0 && !_region.flush(0, 0, _durability == Durability::None))
+        {
+            throw std::runtime_error("Mapped destination cannot be flushed");
+        }
+        _region = boost::interprocess::mapped_region();
+    }
+
+private:
+    boost::interprocess::file_mapping _mapping;
+    boost::interprocess::mapped_region _region;
+    std::size_t _offset = 0;
+    Durability _durability = Durability::None;
+};
+
+#ifndef _WIN32
+class FileDescriptor
+{
+public:
+    FileDescriptor() = default;
+    explicit FileDescriptor(int fd) : _fd{fd} {}
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+    FileDescriptor(FileDescriptor &&other) noexcept : _fd{std::exchange(other._fd, -1)} {}
+    FileDescriptor &operator=(FileDescriptor &&other) noexcept
+    {
+        std::swap(_fd, other._fd);
+        return *this;
+    }
+
+    ~FileDescriptor()
+    {
+        if (_fd >= 0)
+        {
+            ::close(_fd);
+        }
+    }
+
+    int Get() const
+    {
+        return _fd;
+    }
+
+    // Closes the descriptor and reports whether the kernel accepted all pending writes.
+    bool Close()
+    {
+        return ::close(std::exchange(_fd, -1)) == 0;
+    }
+
+private:
+    int _fd = -1;
+};
+
+class FdSource
+{
+public:
+    void Open(const std::filesystem::path &path)
+    {
+        _path = path;
+        _file = FileDescriptor(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        struct stat status;
+        if (_file.Get() < 0 || ::fstat(_file.Get(), &status) != 0)
+        {
+            throw std::runtime_error("File " + path.generic_string() + " cannot be opened for reading");
+        }
+        _size = static_cast<std::uintmax_t>(status.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(_file.Get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    std::size_t Read(char *data, std::size_t size)
+    {
+        std::size_t total = 0;
+        while (total < size)
+        {
+            auto result = ::read(_file.Get(), data + total, size - total);
+            if (result == 0)
+            {
+                break;
+            }
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("File " + _path.generic_string() + " cannot be read");
+            }
+            total += static_cast<std::size_t>(result);
+        }
+        return total;
+    }
+
+    std::uintmax_t Size() const
+    {
+        return _size;
+    }
+
+    int Descriptor() const
+    {
+        return _file.Get();
+    }
+
+private:
+    std::filesystem::path _path;
+    FileDescriptor _file;
+    std::uintmax_t _size = 0;
+};
+
+// Smooths writeback of a file written sequentially through a descriptor: the file is preallocated,
+// completed windows are submitted for writeback as soon as they are written, and the window before
+// them is waited for and dropped from the page cache. Without the kernel hints this only syncs.
+class WriteBehind
+{
+public:
+    void Start(int fd, std::uintmax_t size, const WritebackOptions &options)
+    {
+        _fd = fd;
+        _options = options;
+        _window = options._writeBehindWindow;
+#ifdef __linux__
+        if (size != 0)
+        {
+            // Best effort: filesystems without fallocate support simply allocate on write.
+            ::fallocate(_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+        }
+#else
+        (void)size;
+#endif
+    }
+
+    void Advance(std::size_t written)
+    {
+        _position += written;
+#ifdef __linux__
+        while (_window != 0 && _position - _submitted >= _window)
+        {
+            if (!writeBack(_submitted, _window, SYNC_FILE_RANGE_WRITE))
+            {
+                break;
+            }
+            _submitted += _window;
+            if (_submitted - _dropped > _window)
+            {
+                if (!writeBack(_dropped, _window, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER))
+                {
+                    break;
+                }
+                dropCache(_dropped, _window);
+                _dropped += _window;
+            }
+        }
+#endif
+        if (_options._durability == Durability::Periodic && _position - _synced >= _options._syncInterval)
+        {
+            sync();
+        }
+    }
+
+    void Finish()
+    {
+        if (_options._durability != Durability::None)
+        {
+            sync();
+        }
+#ifdef __linux__
+        if (_window != 0 && _position != _dropped)
+        {
+            if (_options._durability == Durability::None && !writeBack(_submitted, 0, SYNC_FILE_RANGE_WRITE))
+            {
+                return;
+            }
+            dropCache(_dropped, 0);
+        }
+#endif
+    }
+
+private:
+    void sync()
+    {
+        if (::fdatasync(_fd) != 0)
+        {
+            throw std::runtime_error("Written data cannot be synchronized to the disk");
+        }
+        _synced = _position;
+    }
+
+#ifdef __linux__
+    // False when the file does not support sync_file_range; writeback is then left to the kernel.
+    bool writeBack(std::uintmax_t offset, std::uintmax_t length, unsigned int flags)
+    {
+        if (::sync_file_range(_fd, static_cast<off_t>(offset), static_cast<off_t>(length), flags) == 0)
+        {
+            return true;
+        }
+        if (errno == EINVAL || errno == ENOSYS || errno == ESPIPE || errno == EOPNOTSUPP)
+        {
+            _window = 0;
+            return false;
+        }
+        throw std::runtime_error("Written data cannot be written back to the disk");
+    }
+
+    // Dropping the written pages is only a hint, so a file that rejects it keeps them cached.
+    void dropCache(std::uintmax_t offset, std::uintmax_t length)
+    {
+        if (::posix_fadvise(_fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED) != 0)
+        {
+            _window = 0;
+        }
+    }
+#endif
+
+    int _fd = -1;
+    WritebackOptions _options;
+    std::size_t _window = 0;
+    std::uintmax_t _position = 0;
+    std::uintmax_t _submitted = 0;
+    std::uintmax_t _dropped = 0;
+    std::uintmax_t _synced = 0;
+};
+
+class FdSink
+{
+public:
+    void Open(const std::filesystem::path &path, std::uintmax_t size, const WritebackOptions &writeback)
+    {
+        _path = path;
+        _file = FileDescriptor(::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644));
+        if (_file.Get() < 0)
+        {
+            throw std::runtime_error("File " + path.generic_string() + " cannot be opened for writing");
+        }
+        _writeBehind.Start(_file.Get(), size, writeback);
+    }
+
+    void Write(const char *data, std::size_t size)
+    {
+        while (size != 0)
+        {
+            auto result = ::write(_file.Get(), data, size);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("File " + _path.generic_string() + " cannot be written");
+            }
+            data += result;
+            size -= static_cast<std::size_t>(result);
+            _writeBehind.Advance(static_cast<std::size_t>(result));
+        }
+    }
+
+    void Close()
+    {
+        _writeBehind.Finish();
+        if (!_file.Close())
+        {
+            throw std::runtime_error("File " + _path.generic_string() + " cannot be written");
+        }
+    }
+
+    int Descriptor() const
+    {
+        return _file.Get();
+    }
+
+private:
+    std::filesystem::path _path;
+    FileDescriptor _file;
+    WriteBehind _writeBehind;
+};
+
+using NativeSource = FdSource;
+using NativeSink = FdSink;
+#else
+using NativeSource = FstreamSource;
+using NativeSink = FstreamSink;
+#endif
+
+// Every read and write of the engines is admitted by the process-wide IoScheduler.
+template <class SourceT>
+std::size_t ScheduledRead(SourceT &source, char *data, std::size_t size, IoPriority priority)
+{
+    auto io = ScheduledIo(priority, size);
+    return source.Read(data, size);
+}
+
+template <class SinkT>
+void ScheduledWrite(SinkT &sink, const char *data, std::size_t size, IoPriority priority)
+{
+    auto io = ScheduledIo(priority, size);
+    sink.Write(data, size);
+}
+
+// Files up to a tool's small file limit skip its threads, relays and streams: a single statx, then one
+// read and one write through raw descriptors with a reusable thread-local buffer. The limit is the
+// tool's buffer or slot size, capped at SmallFileLimit.
+constexpr auto SmallFileLimit = std::size_t{64 * 1024};
+
+// Copies source when it is a regular file of at most limit bytes and returns the copied size. Otherwise,
+// or when the source grows past the size statx reported, nothing is written and the caller copies it the
+// regular way.
+std::optional<std::uintmax_t> TryCopySmallFile(const std::filesystem::path &source,
+                                               const std::filesystem::path &destination,
+                                               std::size_t limit,
+                                               const WritebackOptions &writeback,
+                                               IoPriority priority);
+
+// Wraps copyTool so CopyFile takes TryCopySmallFile first. CopyFileAsync is left to copyTool.
+ICopyToolPtrU CreateSmallFileCopyTool(ICopyToolPtrU copyTool, std::size_t limit, WritebackOptions writeback, IoPriority priority);
+
+// Size of a copy buffer for a file of fileSize bytes: no larger than the file, since the buffer is
+// zero-filled on allocation, but at least one byte so the end of an empty file can be read.
+inline std::size_t CopyBufferSize(std::size_t bufferSize, std::uintmax_t fileSize)
+{
+    return static_cast<std::size_t>(std::min<std::uintmax_t>(bufferSize, std::max<std::uintmax_t>(1, fileSize)));
+}
+
+// Handoff policies move data from an opened source to an opened sink.
+struct InlineHandoff
+{
+    template <class SourceT, class SinkT>
+    static void Transfer(SourceT &source, SinkT &sink, std::size_t bufferSize, IoPriority priority)
+    {
+        auto buffer = std::vector<char>(CopyBufferSize(bufferSize, source.Size()));
+        while (auto size = ScheduledRead(source, buffer.data(), buffer.size(), priority))
+        {
+            ScheduledWrite(sink, buffer.data(), size, priority);
+        }
+    }
+};
+
+// Reads on a separate thread into one buffer while the calling thread writes the other.
+struct ThreadedHandoff
+{
+    template <class SourceT, class SinkT>
+    static void Transfer(SourceT &source, SinkT &sink, std::size_t bufferSize, IoPriority priority)
+    {
+        bufferSize = CopyBufferSize(bufferSize, source.Size());
+        auto sharedBuffer = std::vector<char>(bufferSize);
+        auto sharedSize = std::size_t{0};
+        auto bufferReady = false;
+        auto readingFinished = false;
+        auto writingFailed = false;
+        auto readerError = std::exception_ptr{};
+        auto mutex = std::mutex{};
+        auto conditionalVariable = std::condition_variable{};
+
+        auto reader = std::thread([&]()
+                                  {
+            auto localBuffer = std::vector<char>(bufferSize);
+            try
+            {
+                while (true)
+                {
+                    auto size = ScheduledRead(source, localBuffer.data(), localBuffer.size(), priority);
+                    std::unique_lock<std::mutex> lock(mutex);
+                    conditionalVariable.wait(lock, [&]()
+                                             { return !bufferReady || writingFailed; });
+                    if (writingFailed || size == 0)
+                    {
+                        break;
+                    }
+                    std::swap(sharedBuffer, localBuffer);
+                    sharedSize = size;
+                    bufferReady = true;
+                    conditionalVariable.notify_one();
+                }
+            }
+            catch (...)
+            {
+                readerError = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            readingFinished = true;
+            conditionalVariable.notify_one(); });
+
+        auto localBuffer = std::vector<char>(bufferSize);
+        try
+        {
+            while (true)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                conditionalVariable.wait(lock, [&]()
+                                         { return bufferReady || readingFinished; });
+                if (!bufferReady)
+                {
+                    break;
+                }
+                std::swap(sharedBuffer, localBuffer);
+                auto size = sharedSize;
+                bufferReady = false;
+                conditionalVariable.notify_one();
+                lock.unlock();
+                ScheduledWrite(sink, localBuffer.data(), size, priority);
+            }
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                writingFailed = true;
+                conditionalVariable.notify_one();
+            }
+            reader.join();
+            throw;
+        }
+        reader.join();
+        if (readerError)
+        {
+            std::rethrow_exception(readerError);
+        }
+    }
+};
+
+// Executes a task on the shared copy executor used by CopyFileAsync.
+void PostCopyTask(std::function<void()> task);
+
+// Executes a task on the shared copy executor once delay has passed, without holding a thread meanwhile.
+void PostCopyTaskAfter(std::chrono::steady_clock::duration delay, std::function<void()> task);
+
+// Executes a CPU-bound task on a pool separate from the copy executor, so copy tasks may wait for it.
+void PostCompressionTask(std::function<void()> task);
+
+// Decorating policies such as CompressingSink take the compression options on construction.
+template <class Policy>
+Policy MakePolicy(const CompressionOptions &compression)
+{
+    if constexpr (std::is_constructible_v<Policy, const CompressionOptions &>)
+    {
+        return Policy(compression);
+    }
+    else
+    {
+        return Policy();
+    }
+}
+
+// Copies a file in bufferSize steps, each posted as a separate executor task,
+// so many copies interleave on a few executor threads. A step that the I/O scheduler does not admit yet
+// is posted again for later instead of sleeping on an executor thread.
+template <class SourcePolicy, class SinkPolicy>
+class ChunkedCopyJob : public std::enable_shared_from_this<ChunkedCopyJob<SourcePolicy, SinkPolicy>>
+{
+public:
+    ChunkedCopyJob(std::filesystem::path source,
+                   std::filesystem::path destination,
+                   std::size_t bufferSize,
+                   WritebackOptions writeback,
+                   CompressionOptions compression,
+                   IoPriority priority,
+                   CopyProgressCallback progress,
+                   std::stop_token stopToken)
+        : _source{std::move(source)},
+          _destination{std::move(destination)},
+          _bufferSize{bufferSize},
+          _writeback{writeback},
+          _compression{compression},
+          _priority{priority},
+          _progress{std::move(progress)},
+          _stopToken{std::move(stopToken)}
+    {
+    }
+
+    std::future<void> Start()
+    {
+        auto future = _promise.get_future();
+        post(std::chrono::steady_clock::duration::zero());
+        return future;
+    }
+
+private:
+    // Caps how long a waiting job goes without checking its stop token.
+    static constexpr auto MaxStepDelay = std::chrono::milliseconds(20);
+
+    void Step()
+    {
+        try
+        {
+            if (_stopToken.stop_requested())
+            {
+                throw CopyCancelledError("Copying of " + _source.generic_string() + " was cancelled");
+            }
+            if (!_sourceFile)
+            {
+                open();
+            }
+            if (!_readSize)
+            {
+                if (!admit(_buffer.size()))
+                {
+                    return;
+                }
+                auto io = ScheduledIo(_priority);
+                _readSize = _sourceFile->Read(_buffer.data(), _buffer.size());
+            }
+            if (!admit(*_readSize))
+            {
+                return;
+            }
+            auto size = *_readSize;
+            {
+                auto io = ScheduledIo(_priority);
+                _destinationFile->Write(_buffer.data(), size);
+            }
+            _readSize.reset();
+            _copiedBytes += size;
+            if (_progress)
+            {
+                _progress(CopyProgress{_copiedBytes, _sourceFile->Size()});
+            }
+            if (size == 0 || _copiedBytes >= _sourceFile->Size())
+            {
+                _destinationFile->Close();
+                release();
+                _promise.set_value();
+                return;
+            }
+            post(std::chrono::steady_clock::duration::zero());
+        }
+        catch (...)
+        {
+            // A failed or cancelled copy leaves no partial destination behind.
+            auto wasOpened = static_cast<bool>(_destinationFile);
+            release();
+            if (wasOpened)
+            {
+                auto error = std::error_code{};
+                std::filesystem::remove(_destination, error);
+            }
+            _promise.set_exception(std::current_exception());
+        }
+    }
+
+    // False when the operation is not admitted yet and the step has been posted again.
+    bool admit(std::size_t bytes)
+    {
+        if (!_admittedAt)
+        {
+            auto reservation = IoScheduler::Instance().TryReserve(_priority, bytes);
+            if (!reservation._reserved)
+            {
+                post(reservation._delay);
+                return false;
+            }
+            _admittedAt = std::chrono::steady_clock::now() + reservation._delay;
+        }
+        auto remaining = *_admittedAt - std::chrono::steady_clock::now();
+        if (remaining > std::chrono::steady_clock::duration::zero())
+        {
+            post(remaining);
+            return false;
+        }
+        _admittedAt.reset();
+        return true;
+    }
+
+    void post(std::chrono::steady_clock::duration delay)
+    {
+        PostCopyTaskAfter(std::min<std::chrono::steady_clock::duration>(delay, MaxStepDelay), [job = this->shared_from_this()]()
+                          { job->Step(); });
+    }
+
+    void open()
+    {
+        _sourceFile.reset(new SourcePolicy(MakePolicy<SourcePolicy>(_compression)));
+        _sourceFile->Open(_source);
+        std::filesystem::remove(_destination);
+        _destinationFile.reset(new SinkPolicy(MakePolicy<SinkPolicy>(_compression)));
+        _destinationFile->Open(_destination, _sourceFile->Size(), _writeback);
+        _buffer.resize(CopyBufferSize(_bufferSize, _sourceFile->Size()));
+    }
+
+    void release()
+    {
+        _sourceFile.reset();
+        _destinationFile.reset();
+        _buffer = std::vector<char>();
+    }
+
+    std::filesystem::path _source;
+    std::filesystem::path _destination;
+    std::size_t _bufferSize;
+    WritebackOptions _writeback;
+    CompressionOptions _compression;
+    IoPriority _priority;
+    CopyProgressCallback _progress;
+    std::stop_token _stopToken;
+    std::promise<void> _promise;
+    std::unique_ptr<SourcePolicy> _sourceFile;
+    std::unique_ptr<SinkPolicy> _destinationFile;
+    std::vector<char> _buffer;
+    std::uintmax_t _copiedBytes = 0;
+    // Size of the chunk read but not written yet.
+    std::optional<std::size_t> _readSize;
+    std::optional<std::chrono::steady_clock::time_point> _admittedAt;
+};
+
+// The whole open/read/write loop is instantiated per policy combination,
+// leaving CopyFile itself as the only virtual call per copied file.
+template <class SourcePolicy, class SinkPolicy, class HandoffPolicy>
+class CopyEngine final : public ICopyTool
+{
+public:
+    explicit CopyEngine(std::size_t bufferSize,
+                        WritebackOptions writeback = {},
+                        CompressionOptions compression = {},
+                        IoPriority priority = IoPriority::Foreground)
+        : _bufferSize{bufferSize},
+          _writeback{writeback},
+          _compression{compression},
+          _priority{priority}
+    {
+    }
+
+    void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination) override
+    {
+        auto sourceFile = MakePolicy<SourcePolicy>(_compression);
+        sourceFile.Open(source);
+        std::filesystem::remove(destination);
+        auto destinationFile = MakePolicy<SinkPolicy>(_compression);
+        destinationFile.Open(destination, sourceFile.Size(), _writeback);
+        HandoffPolicy::Transfer(sourceFile, destinationFile, _bufferSize, _priority);
+        destinationFile.Close();
+    }
+
+    std::future<void> CopyFileAsync(const std::filesystem::path &source,
+                                    const std::filesystem::path &destination,
+                                    CopyProgressCallback progress,
+                                    std::stop_token stopToken) override
+    {
+        return std::make_shared<ChunkedCopyJob<SourcePolicy, SinkPolicy>>(
+                   source, destination, _bufferSize, _writeback, _compression, _priority, std::move(progress), std::move(stopToken))
+            ->Start();
+    }
+
+private:
+    std::size_t _bufferSize;
+    WritebackOptions _writeback;
+    CompressionOptions _compression;
+    IoPriority _priority;
+};
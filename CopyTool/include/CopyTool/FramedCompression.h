@@ -0,0 +1,158 @@
+#pragma once
+#include "ICopyTool.h"
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <optional>
+#include <vector>
+
+// Framed format: a file header, then frames of up to _frameSize content bytes, each stored as a frame
+// header and its payload, then a seek table with the file offset of every frame and a footer.
+// Frame i holds the content starting at i * _frameSize, so any range can be decoded through the
+// seek table without touching the frames before it. A frame whose stored size equals its content
+// size is kept raw, which is how incompressible data passes through.
+
+// Codecs are optional build dependencies; using one that is not built in throws.
+bool IsCodecAvailable(CompressionCodec codec);
+
+// Splits the written content into frames and compresses them on the compression pool
+// while the caller keeps writing; frames reach output in order.
+class FrameEncoder
+{
+public:
+    using Output = std::function<void(const char *, std::size_t)>;
+
+    FrameEncoder(CompressionOptions options, Output output);
+
+    // Writes the file header; size is the content size and must match what is written.
+    void Begin(std::uintmax_t size);
+    void Write(const char *data, std::size_t size);
+    // Flushes the remaining frames and writes the seek table.
+    void Finish();
+
+private:
+    void submit();
+    void writeFront();
+
+    CompressionOptions _options;
+    Output _output;
+    std::vector<char> _pending;
+    std::deque<std::future<std::vector<char>>> _frames;
+    std::vector<std::uint64_t> _frameOffsets;
+    std::uintmax_t _size = 0;
+    std::uintmax_t _received = 0;
+    std::uint64_t _offset = 0;
+};
+
+// Reads the framed format sequentially from input, decompressing the next frames on the
+// compression pool ahead of the caller.
+class FrameDecoder
+{
+public:
+    using Input = std::function<std::size_t(char *, std::size_t)>;
+
+    explicit FrameDecoder(Input input);
+
+    // Reads the file header and returns the content size.
+    std::uintmax_t Begin();
+    std::size_t Read(char *data, std::size_t size);
+
+private:
+    void prefetch();
+
+    Input _input;
+    CompressionCodec _codec = CompressionCodec::Lz4;
+    std::size_t _frameSize = 0;
+    std::uintmax_t _unread = 0;
+    std::deque<std::future<std::vector<char>>> _frames;
+    std::vector<char> _current;
+    std::size_t _currentOffset = 0;
+};
+
+// Random access to the content of a framed file through its seek table.
+class FramedFileReader
+{
+public:
+    explicit FramedFileReader(const std::filesystem::path &path);
+
+    std::uintmax_t Size() const
+    {
+        return _size;
+    }
+
+    // Reads up to size content bytes starting at offset, decoding only the frames covering them.
+    std::size_t ReadAt(std::uintmax_t offset, char *data, std::size_t size);
+
+private:
+    std::filesystem::path _path;
+    std::ifstream _file;
+    CompressionCodec _codec = CompressionCodec::Lz4;
+    std::size_t _frameSize = 0;
+    std::uintmax_t _size = 0;
+    std::vector<std::uint64_t> _frameOffsets;
+};
+
+// Sink policy decorator writing the destination in the framed format.
+template <class SinkT>
+class CompressingSink
+{
+public:
+    explicit CompressingSink(const CompressionOptions &compression) : _compression{compression} {}
+
+    void Open(const std::filesystem::path &path, std::uintmax_t size, const WritebackOptions &writeback)
+    {
+        // The compressed size is unknown up front, so nothing is preallocated.
+        _sink.Open(path, 0, writeback);
+        _encoder.emplace(_compression, [this](const char *data, std::size_t length)
+                         { _sink.Write(data, length); });
+        _encoder->Begin(size);
+    }
+
+    void Write(const char *data, std::size_t size)
+    {
+        _encoder->Write(data, size);
+    }
+
+    void Close()
+    {
+        _encoder->Finish();
+        _sink.Close();
+    }
+
+private:
+    CompressionOptions _compression;
+    SinkT _sink;
+    std::optional<FrameEncoder> _encoder;
+};
+
+// Source policy decorator reading a framed source; Size is the decompressed size.
+template <class SourceT>
+class DecompressingSource
+{
+public:
+    void Open(const std::filesystem::path &path)
+    {
+        _source.Open(path);
+        _decoder.emplace([this](char *data, std::size_t length)
+                         { return _source.Read(data, length); });
+        _size = _decoder->Begin();
+    }
+
+    std::size_t Read(char *data, std::size_t size)
+    {
+        return _decoder->Read(data, size);
+    }
+
+    std::uintmax_t Size() const
+    {
+        return _size;
+    }
+
+private:
+    SourceT _source;
+    std::optional<FrameDecoder> _decoder;
+    std::uintmax_t _size = 0;
+};
@@ -1,20 +1,133 @@
 #pragma once
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <memory>
+#include <stdexcept>
+#include <stop_token>
+
+struct CopyProgress
+{
+    std::uintmax_t _copiedBytes;
+    std::uintmax_t _totalBytes;
+};
+
+using CopyProgressCallback = std::function<void(const CopyProgress &)>;
+
+class CopyCancelledError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+enum class Durability
+{
+    // Data reaches the disk whenever the kernel writes it back.
+    None,
+    // fdatasync once the whole file is written.
+    FdatasyncAtEnd,
+    // fdatasync every _syncInterval bytes and once the whole file is written.
+    Periodic
+};
+
+struct WritebackOptions
+{
+    // Written data is pushed to the disk this many bytes behind the write position and then
+    // dropped from the page cache, so dirty pages do not pile up. Each window waits for the previous
+    // one to reach the disk, which stalls the writer on slow devices, so it is off (0) unless asked for.
+    std::size_t _writeBehindWindow = 0;
+    Durability _durability = Durability::None;
+    std::size_t _syncInterval = 256 * 1024 * 1024;
+};
+
+enum class CompressionMode
+{
+    None,
+    // The destination is written in the framed format.
+    Compress,
+    // The source is read in the framed format and the destination gets the original content.
+    Decompress
+};
+
+enum class CompressionCodec : std::uint32_t
+{
+    Lz4,
+    Zstd
+};
+
+struct CompressionOptions
+{
+    CompressionMode _mode = CompressionMode::None;
+    CompressionCodec _codec = CompressionCodec::Lz4;
+    // zstd compression level; lz4 ignores it.
+    int _level = 1;
+    // Uncompressed bytes per frame, the unit of parallel compression and of random access.
+    std::size_t _frameSize = 1024 * 1024;
+};
+
+// Scheduling class of a copy tool's reads and writes in the process-wide IoScheduler.
+enum class IoPriority
+{
+    Foreground,
+    Background
+};
 
 class ICopyTool
 {
 public:
     virtual void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination) = 0;
+
+    // Schedules the copy on the shared copy executor and returns immediately.
+    // Progress is reported from executor threads. A stop request aborts the copy at the next chunk,
+    // removes the partial destination and fails the future with CopyCancelledError.
+    // The default implementation runs CopyFile on a thread of its own and, as CopyFile cannot be interrupted,
+    // honors a stop request made during the copy by removing the destination once it returns.
+    // The tool must outlive the future.
+    virtual std::future<void> CopyFileAsync(const std::filesystem::path &source,
+                                            const std::filesystem::path &destination,
+                                            CopyProgressCallback progress = {},
+                                            std::stop_token stopToken = {});
     virtual ~ICopyTool() = default;
 };
 
 using ICopyToolPtrU = std::unique_ptr<ICopyTool>;
 
-ICopyToolPtrU CreateStlCopyTool();
+// Copies with std::filesystem::copy_file, bypassing the I/O scheduler, while it has no limits and tracks no latency.
+// Otherwise the file goes through the scheduler in 1 MiB chunks.
+ICopyToolPtrU CreateStlCopyTool(IoPriority priority = IoPriority::Foreground);
+
+ICopyToolPtrU CreateSingleThreadedCopyTool(std::size_t bufferSize, WritebackOptions writeback = {},
+                                           IoPriority priority = IoPriority::Foreground);
+
+ICopyToolPtrU CreateTwoThreadedCopyTool(std::size_t bufferSize, WritebackOptions writeback = {}, CompressionOptions compression = {},
+                                        IoPriority priority = IoPriority::Foreground);
+
+struct SharedMemoryOptions
+{
+    // Size of each of the two relay buffers. Both processes of a pair must use the same value.
+    std::size_t _slotSize = 1024;
+    // Throws after the first relayed block to exercise the reader failure path.
+    bool _injectFailure = false;
+    WritebackOptions _writeback;
+    // Compression runs in the writer process, decompression in the reader process.
+    CompressionOptions _compression;
+    IoPriority _priority = IoPriority::Foreground;
+    // The reader copies files up to the slot size (at most 64 KiB) on its own and tells the writer so.
+    // Off keeps every copy on the relay.
+    bool _smallFileCopy = true;
+};
 
-ICopyToolPtrU CreateSingleThreadedCopyTool(std::size_t bufferSize);
+ICopyToolPtrU CreateSharedMemoryCopyTool(std::string_view sharedMemoryName, SharedMemoryOptions options = {});
 
-ICopyToolPtrU CreateTwoThreadedCopyTool(std::size_t bufferSize);
+// Cross-process alternative to the shared memory relay (Linux only). The first process of a session
+// opens the source and passes its descriptor over a Unix domain socket; the second copies it inside
+// the kernel with copy_file_range, falling back to sendfile, and reports progress back. With smallFileCopy
+// the first process copies files up to 64 KiB on its own and only tells the second one it is done.
+ICopyToolPtrU CreateFdPassingCopyTool(std::string_view sessionName, WritebackOptions writeback = {},
+                                      IoPriority priority = IoPriority::Foreground, bool smallFileCopy = true);
 
-ICopyToolPtrU CreateSharedMemoryCopyTool(std::string_view sharedMemoryName);
\ No newline at end of file
+// Wraps copyTool with a persistent content index stored at indexPath. A copy whose content was already
+// written by an earlier copy is satisfied by a reflink of that file, or by a hard link when allowHardLinks
+// is set; hard-linked destinations share one inode, so modifying one in place modifies all of them.
+ICopyToolPtrU CreateDedupCopyTool(ICopyToolPtrU copyTool, std::filesystem::path indexPath, bool allowHardLinks = false);
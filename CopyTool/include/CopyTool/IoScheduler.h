@@ -0,0 +1,145 @@
+#pragma once
+#include "ICopyTool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct IoLimits
+{
+    // 0 turns the corresponding limit off.
+    std::uint64_t _bytesPerSecond = 0;
+    std::uint64_t _operationsPerSecond = 0;
+};
+
+// Outcome of IoScheduler::TryReserve. A reserved operation may start after _delay without asking again;
+// an operation that is not reserved asks again after _delay.
+struct IoReservation
+{
+    bool _reserved = false;
+    std::chrono::steady_clock::duration _delay{};
+};
+
+// Process-wide token bucket scheduler for the reads and writes of every copy tool.
+// Foreground operations are admitted before any waiting background operation. With a latency target
+// set, background operations also share an adaptive rate cap: it is halved whenever the p99 latency
+// of the last window exceeds the target and grows back while it stays below. The window uses the
+// foreground samples, or the background ones when no foreground copy is running in this process,
+// since their latency then reflects the disk queue shared with other services.
+class IoScheduler
+{
+public:
+    static IoScheduler &Instance();
+
+    // May be called at any time; waiting operations pick up the new limits.
+    void SetLimits(IoLimits limits);
+    IoLimits GetLimits() const;
+
+    // Zero turns the latency control off and lifts the background cap.
+    void SetForegroundLatencyTarget(std::chrono::microseconds target);
+    std::chrono::microseconds GetForegroundLatencyTarget() const;
+
+    // Bytes per second background operations are currently capped at, 0 when they are not capped.
+    std::uint64_t GetBackgroundRate() const;
+
+    // Blocks until an operation of bytes may start. Operations larger than the burst go into debt,
+    // which the next operations wait out.
+    void Acquire(IoPriority priority, std::size_t bytes);
+
+    // Non-blocking Acquire for tasks that must not sleep on a shared executor thread. A foreground
+    // operation is always reserved, taking its tokens at once, so background operations cannot overtake
+    // it while it waits. A background operation is only reserved when it may start right away.
+    IoReservation TryReserve(IoPriority priority, std::size_t bytes);
+
+    bool TracksLatency() const
+    {
+        return _latencyTarget.load(std::memory_order_relaxed) != 0;
+    }
+
+    void ReportLatency(IoPriority priority, std::chrono::nanoseconds latency);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    class TokenBucket
+    {
+    public:
+        void SetRate(std::uint64_t rate, Clock::time_point now);
+        std::uint64_t Rate() const
+        {
+            return _rate;
+        }
+        // Time until the bucket is out of debt.
+        Clock::duration Wait(Clock::time_point now);
+        void Take(double amount);
+
+    private:
+        void refill(Clock::time_point now);
+
+        std::uint64_t _rate = 0;
+        double _tokens = 0;
+        Clock::time_point _refilled;
+    };
+
+    IoScheduler() = default;
+
+    void take(IoPriority priority, std::size_t bytes);
+    void updateActive();
+    void adjustBackgroundRate(Clock::time_point now);
+
+    mutable std::mutex _mutex;
+    std::condition_variable _conditionalVariable;
+    std::atomic<bool> _active = false;
+    std::atomic<std::int64_t> _latencyTarget = 0;
+    IoLimits _limits;
+    TokenBucket _bytes;
+    TokenBucket _operations;
+    TokenBucket _background;
+    std::size_t _foregroundWaiting = 0;
+    Clock::time_point _windowStart;
+    std::uintmax_t _backgroundBytes = 0;
+    std::vector<std::chrono::nanoseconds> _foregroundSamples;
+    std::vector<std::chrono::nanoseconds> _backgroundSamples;
+};
+
+// Admits one I/O operation through the scheduler and reports its latency when it completes.
+class ScheduledIo
+{
+public:
+    ScheduledIo(IoPriority priority, std::size_t bytes) : _priority{priority}
+    {
+        auto &scheduler = IoScheduler::Instance();
+        scheduler.Acquire(priority, bytes);
+        if (scheduler.TracksLatency())
+        {
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+
+    // For an operation admitted beforehand through TryReserve; only its latency is reported.
+    explicit ScheduledIo(IoPriority priority) : _priority{priority}
+    {
+        if (IoScheduler::Instance().TracksLatency())
+        {
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ScheduledIo(const ScheduledIo &) = delete;
+    ScheduledIo &operator=(const ScheduledIo &) = delete;
+
+    ~ScheduledIo()
+    {
+        if (_start != std::chrono::steady_clock::time_point{})
+        {
+            IoScheduler::Instance().ReportLatency(_priority, std::chrono::steady_clock::now() - _start);
+        }
+    }
+
+private:
+    IoPriority _priority;
+    std::chrono::steady_clock::time_point _start;
+};
@@ -1,7 +1,20 @@
 #include <gtest/gtest.h>
-#include <CopyTool/ICopyTool.h>
+#include <CopyTool/CopyEngine.h>
+#include <CopyTool/FramedCompression.h>
+#include <CopyTool/IoScheduler.h>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <random>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
 
 TEST(CopyToolTestSuite, StlCopyToolCreatorTest)
 {
@@ -21,6 +34,9 @@ TEST(CopyToolTestSuite, TwoThreadedCopyToolCreatorTest)
 TEST(CopyToolTestSuite, SharedMemoryCopyTool)
 {
     EXPECT_NO_THROW(CreateSharedMemoryCopyTool("sm1"));
+    auto options = SharedMemoryOptions{};
+    options._slotSize = 0;
+    EXPECT_THROW(CreateSharedMemoryCopyTool("sm1", options), std::invalid_argument);
 }
 
 namespace
@@ -65,37 +81,48 @@ namespace
     constexpr auto Mb = std::size_t{1024 * Kb};
     constexpr auto Gb = std::size_t{1024 * Mb};
 
-    void GenerateBinaryFile(const std::filesystem::path &filename, std::size_t fileSize, std::size_t bufferSize = Mb)
+    // Counter-based generator: word i depends only on the seed and i, so the file is reproducible
+    // and every part of a block can be generated independently on its own thread.
+    std::uint64_t RandomWord(std::uint64_t seed, std::uint64_t index)
     {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, 255);
-
-        std::ofstream outFile(filename, std::ios_base::out | std::ios_base::binary);
-
-        std::size_t iterations = fileSize / bufferSize;
-        std::size_t remaining = fileSize % bufferSize;
-
-        std::vector<char> buffer(bufferSize);
+        auto word = seed + (index + 1) * 0x9E3779B97F4A7C15ull;
+        word = (word ^ (word >> 30)) * 0xBF58476D1CE4E5B9ull;
+        word = (word ^ (word >> 27)) * 0x94D049BB133111EBull;
+        return word ^ (word >> 31);
+    }
 
-        for (std::size_t i = 0; i < iterations; ++i)
+    void FillRandom(char *data, std::size_t size, std::uint64_t seed, std::uint64_t firstWord)
+    {
+        auto words = size / sizeof(std::uint64_t);
+        for (std::size_t i = 0; i < words; ++i)
         {
-            for (auto &b : buffer)
-            {
-                b = static_cast<char>(dis(gen));
-            }
-
-            outFile.write(buffer.data(), buffer.size());
+            auto word = RandomWord(seed, firstWord + i);
+            std::memcpy(data + i * sizeof(word), &word, sizeof(word));
         }
+        auto word = RandomWord(seed, firstWord + words);
+        std::memcpy(data + words * sizeof(word), &word, size % sizeof(word));
+    }
 
-        buffer.resize(remaining);
+    void GenerateBinaryFile(const std::filesystem::path &filename, std::size_t fileSize, std::uint64_t seed = 0, std::size_t bufferSize = 64 * Mb)
+    {
+        auto threadCount = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        auto partSize = (bufferSize / threadCount + 7) & ~std::size_t{7};
+        std::vector<char> buffer(std::min(bufferSize, fileSize));
 
-        for (auto &b : buffer)
+        std::ofstream outFile(filename, std::ios_base::out | std::ios_base::binary);
+        for (std::size_t offset = 0; offset < fileSize; offset += bufferSize)
         {
-            b = static_cast<char>(dis(gen));
+            auto blockSize = std::min(bufferSize, fileSize - offset);
+            {
+                std::vector<std::jthread> workers;
+                for (std::size_t begin = 0; begin < blockSize; begin += partSize)
+                {
+                    workers.emplace_back(FillRandom, buffer.data() + begin, std::min(partSize, blockSize - begin),
+                                         seed, (offset + begin) / sizeof(std::uint64_t));
+                }
+            }
+            outFile.write(buffer.data(), blockSize);
         }
-
-        outFile.write(buffer.data(), buffer.size());
         outFile.close();
     }
 
@@ -139,13 +166,60 @@ namespace
         std::vector<std::size_t> _bufferSizes;
     };
 
+    std::string SizeName(std::size_t size)
+    {
+        if (size >= Gb)
+        {
+            return std::to_string(size / Gb) + "Gb";
+        }
+        if (size >= Mb)
+        {
+            return std::to_string(size / Mb) + "Mb";
+        }
+        if (size >= Kb)
+        {
+            return std::to_string(size / Kb) + "Kb";
+        }
+        return std::to_string(size) + "b";
+    }
+
     class CopyToolTestFixture : public ::testing::TestWithParam<TestParams>
     {
+    public:
+        static void TearDownTestSuite()
+        {
+            sources().clear();
+        }
+
+    protected:
+        // All tests of one file size copy the same source, so it is generated once per test suite.
+        static std::filesystem::path GetSourcePath()
+        {
+            auto fileSize = GetParam()._fileSize;
+            auto it = sources().find(fileSize);
+            if (it == sources().end())
+            {
+                it = sources().try_emplace(fileSize, "source_" + SizeName(fileSize)).first;
+                GenerateBinaryFile(it->second.GetPath(), fileSize, fileSize);
+            }
+            return it->second.GetPath();
+        }
+
+    private:
+        static std::map<std::size_t, FileGuard> &sources()
+        {
+            static std::map<std::size_t, FileGuard> cachedSources;
+            return cachedSources;
+        }
     };
 }
 
 // clang-format off
 INSTANTIATE_TEST_SUITE_P(CopyToolTestSuite, CopyToolTestFixture, ::testing::Values(
+    TestParams{0, {Kb, Mb}},
+    TestParams{1, {Kb / 4, Kb}},
+    TestParams{4 * Kb, {Kb, 4 * Kb, 64 * Kb}},
+    TestParams{64 * Kb, {Kb, 10 * Kb, 64 * Kb, Mb}},
     TestParams{Kb, {Kb / 4, Kb / 2, Kb, 10 * Kb}},
     TestParams{100 * Kb, {Kb, 10 * Kb, 100 * Kb, Mb}},
     TestParams{Mb, {Kb, 10 * Kb, 100 * Kb, Mb, 10 * Mb}},
@@ -153,75 +227,778 @@ INSTANTIATE_TEST_SUITE_P(CopyToolTestSuite, CopyToolTestFixture, ::testing::Valu
     TestParams{100 * Mb, {Kb, 10 * Kb, 100 * Kb, Mb, 10 * Mb, 100 * Mb, Gb}},
     TestParams{Gb, {Kb, 10 * Kb, 100 * Kb, Mb, 10 * Mb, 100 * Mb, Gb, 2 * Gb}},
     TestParams{10 * Gb, {Kb, 10 * Kb, 100 * Kb, Mb, 10 * Mb, 100 * Mb, Gb, 2 * Gb, 4 * Gb}}
-));
+), [](const ::testing::TestParamInfo<TestParams> &info) { return SizeName(info.param._fileSize); });
 // clang-format on
 
 TEST_P(CopyToolTestFixture, SingleThreadedCopyToolTest)
 {
-    auto source = FileGuard{"source"};
+    auto source = GetSourcePath();
     auto destination = FileGuard{"destination"};
-    GenerateBinaryFile(source.GetPath(), GetParam()._fileSize);
     for (auto bufferSize : GetParam()._bufferSizes)
     {
         auto copyTool = CreateSingleThreadedCopyTool(bufferSize);
-        copyTool->CopyFile(source.GetPath(), destination.GetPath());
-        CompareFiles(source.GetPath(), destination.GetPath());
+        copyTool->CopyFile(source, destination.GetPath());
+        EXPECT_TRUE(CompareFiles(source, destination.GetPath()));
     }
 }
 
 TEST_P(CopyToolTestFixture, TwoThreadedCopyToolTest)
 {
-    auto source = FileGuard{"source"};
+    auto source = GetSourcePath();
     auto destination = FileGuard{"destination"};
-    GenerateBinaryFile(source.GetPath(), GetParam()._fileSize);
     for (auto bufferSize : GetParam()._bufferSizes)
     {
         auto copyTool = CreateTwoThreadedCopyTool(bufferSize);
-        copyTool->CopyFile(source.GetPath(), destination.GetPath());
-        CompareFiles(source.GetPath(), destination.GetPath());
+        copyTool->CopyFile(source, destination.GetPath());
+        EXPECT_TRUE(CompareFiles(source, destination.GetPath()));
     }
 }
 
 TEST_P(CopyToolTestFixture, StlCopyToolTest)
 {
-    auto source = FileGuard{"source"};
+    auto source = GetSourcePath();
     auto destination = FileGuard{"destination"};
-    GenerateBinaryFile(source.GetPath(), GetParam()._fileSize);
     auto copyTool = CreateStlCopyTool();
-    copyTool->CopyFile(source.GetPath(), destination.GetPath());
-    CompareFiles(source.GetPath(), destination.GetPath());
+    copyTool->CopyFile(source, destination.GetPath());
+    EXPECT_TRUE(CompareFiles(source, destination.GetPath()));
 }
 
 TEST_P(CopyToolTestFixture, TimeComparisonTest)
 {
-    auto source = FileGuard{"source"};
-    GenerateBinaryFile(source.GetPath(), GetParam()._fileSize);
+    auto source = GetSourcePath();
+    // Small copies take microseconds, so they are repeated and the average is reported.
+    auto repetitions = std::clamp<std::size_t>(Mb / std::max<std::size_t>(1, GetParam()._fileSize), 1, 1000);
+    auto measure = [&](ICopyTool &copyTool)
+    {
+        auto destination = FileGuard{"destination"};
+        return measureExecutionTime([&]()
+                                    {
+            for (std::size_t i = 0; i < repetitions; ++i)
+            {
+                copyTool.CopyFile(source, destination.GetPath());
+            } }) /
+               static_cast<long long>(repetitions);
+    };
     std::cout << "File size: " << GetParam()._fileSize << std::endl;
     for (auto bufferSize : GetParam()._bufferSizes)
     {
+        std::cout << measure(*CreateSingleThreadedCopyTool(bufferSize))
+                  << " microseconds to copy file using single thread with buffer "
+                  << std::to_string(bufferSize) << std::endl;
+        std::cout << measure(*CreateTwoThreadedCopyTool(bufferSize))
+                  << " microseconds to copy file using two threads with buffer "
+                  << std::to_string(bufferSize) << std::endl;
+    }
+    std::cout << measure(*CreateStlCopyTool())
+              << " microseconds to copy file using stl" << std::endl;
+}
+
+TEST(CopyToolTestSuite, CopyBufferSizeTest)
+{
+    EXPECT_EQ(CopyBufferSize(Mb, 0), 1u);
+    EXPECT_EQ(CopyBufferSize(Mb, 10), 10u);
+    EXPECT_EQ(CopyBufferSize(Kb, 10 * Gb), Kb);
+}
+
+TEST(CopyToolTestSuite, CopyFileAsyncTest)
+{
+    auto source = FileGuard{"async_source"};
+    GenerateBinaryFile(source.GetPath(), 10 * Mb);
+    auto copyTools = std::vector<ICopyToolPtrU>{};
+    copyTools.push_back(CreateStlCopyTool());
+    copyTools.push_back(CreateSingleThreadedCopyTool(100 * Kb));
+    copyTools.push_back(CreateTwoThreadedCopyTool(100 * Kb));
+    auto destinations = std::vector<FileGuard>{};
+    destinations.reserve(copyTools.size());
+    auto futures = std::vector<std::future<void>>{};
+    auto copiedBytes = std::vector<std::atomic<std::uintmax_t>>(copyTools.size());
+    for (std::size_t i = 0; i < copyTools.size(); ++i)
+    {
+        destinations.emplace_back("async_destination" + std::to_string(i));
+        futures.push_back(copyTools[i]->CopyFileAsync(source.GetPath(), destinations[i].GetPath(),
+                                                      [&copiedBytes, i](const CopyProgress &progress)
+                                                      { copiedBytes[i] = progress._copiedBytes; }));
+    }
+    for (std::size_t i = 0; i < copyTools.size(); ++i)
+    {
+        EXPECT_NO_THROW(futures[i].get());
+        EXPECT_EQ(copiedBytes[i], 10 * Mb);
+        EXPECT_TRUE(CompareFiles(source.GetPath(), destinations[i].GetPath()));
+    }
+}
+
+TEST(CopyToolTestSuite, CopyFileAsyncCancellationTest)
+{
+    auto source = FileGuard{"async_source"};
+    auto destination = FileGuard{"async_destination"};
+    GenerateBinaryFile(source.GetPath(), 10 * Mb);
+    auto copyTool = CreateSingleThreadedCopyTool(Kb);
+    auto stopSource = std::stop_source{};
+    auto future = copyTool->CopyFileAsync(source.GetPath(), destination.GetPath(),
+                                          [&stopSource](const CopyProgress &progress)
+                                          {
+                                              if (progress._copiedBytes >= Mb)
+                                              {
+                                                  stopSource.request_stop();
+                                              }
+                                          },
+                                          stopSource.get_token());
+    EXPECT_THROW(future.get(), CopyCancelledError);
+    EXPECT_FALSE(std::filesystem::exists(destination.GetPath()));
+}
+
+namespace
+{
+    // Blocks in CopyFile until released, like a transport waiting for its peer process.
+    class BlockingCopyTool : public ICopyTool
+    {
+    public:
+        explicit BlockingCopyTool(std::shared_future<void> release) : _release{std::move(release)} {}
+
+        void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination) override
+        {
+            _release.wait();
+            std::filesystem::copy_file(source, destination, std::filesystem::copy_options::overwrite_existing);
+        }
+
+    private:
+        std::shared_future<void> _release;
+    };
+}
+
+TEST(CopyToolTestSuite, CopyFileAsyncBlockingToolTest)
+{
+    auto source = FileGuard{"async_blocking_source"};
+    auto destination = FileGuard{"async_blocking_destination"};
+    auto cancelledDestination = FileGuard{"async_blocking_cancelled"};
+    GenerateBinaryFile(source.GetPath(), Mb);
+    auto release = std::promise<void>();
+    auto blockingTool = BlockingCopyTool(release.get_future().share());
+
+    // More blocked copies than the executor has threads.
+    auto blockedFutures = std::vector<std::future<void>>();
+    for (std::size_t i = 0; i < 2 * std::max(2u, std::thread::hardware_concurrency()); ++i)
+    {
+        blockedFutures.push_back(blockingTool.CopyFileAsync(source.GetPath(), destination.GetPath()));
+    }
+    auto stopSource = std::stop_source{};
+    auto cancelledFuture = blockingTool.CopyFileAsync(source.GetPath(), cancelledDestination.GetPath(), {}, stopSource.get_token());
+
+    // The blocked copies hold threads of their own, so chunked copies still make progress.
+    auto chunkedDestination = FileGuard{"async_blocking_chunked"};
+    auto chunkedFuture = CreateSingleThreadedCopyTool(100 * Kb)->CopyFileAsync(source.GetPath(), chunkedDestination.GetPath());
+    EXPECT_EQ(chunkedFuture.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    // A stop requested while CopyFile runs takes effect once it returns.
+    stopSource.request_stop();
+    release.set_value();
+    chunkedFuture.get();
+    EXPECT_TRUE(CompareFiles(source.GetPath(), chunkedDestination.GetPath()));
+    for (auto &future : blockedFutures)
+    {
+        EXPECT_NO_THROW(future.get());
+    }
+    EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+    EXPECT_THROW(cancelledFuture.get(), CopyCancelledError);
+    EXPECT_FALSE(std::filesystem::exists(cancelledDestination.GetPath()));
+}
+
+template <class CopyEngineT>
+class CopyEngineTestFixture : public ::testing::Test
+{
+};
+
+using CopyEngineTypes = ::testing::Types<
+    CopyEngine<FstreamSource, FstreamSink, InlineHandoff>,
+    CopyEngine<MmapSource, MmapSink, InlineHandoff>,
+    CopyEngine<MmapSource, FstreamSink, ThreadedHandoff>,
+    CopyEngine<NativeSource, NativeSink, InlineHandoff>,
+    CopyEngine<NativeSource, NativeSink, ThreadedHandoff>>;
+
+TYPED_TEST_SUITE(CopyEngineTestFixture, CopyEngineTypes);
+
+TYPED_TEST(CopyEngineTestFixture, CopyEngineTest)
+{
+    auto source = FileGuard{"engine_source"};
+    auto destination = FileGuard{"engine_destination"};
+    for (auto fileSize : {std::size_t{0}, Kb + 1, 10 * Mb})
+    {
+        GenerateBinaryFile(source.GetPath(), fileSize);
+        for (auto bufferSize : {Kb, Mb})
         {
-            auto copyTool = CreateSingleThreadedCopyTool(bufferSize);
-            auto destination = FileGuard{"destination"};
-            auto time = measureExecutionTime([&]()
-                                             { copyTool->CopyFile(source.GetPath(), destination.GetPath()); });
-            std::cout << time
-                      << " microseconds to copy file using single thread with buffer "
-                      << std::to_string(bufferSize) << std::endl;
+            auto copyTool = TypeParam(bufferSize);
+            copyTool.CopyFile(source.GetPath(), destination.GetPath());
+            EXPECT_EQ(std::filesystem::file_size(destination.GetPath()), fileSize);
+            EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
         }
+    }
+}
+
+namespace
+{
+    // Whether the working directory's filesystem can share extents between files.
+    bool SupportsReflinks()
+    {
+#if defined(__linux__) && defined(FICLONE)
+        auto source = FileGuard{"reflink_probe_source"};
+        auto destination = FileGuard{"reflink_probe_destination"};
+        std::ofstream(source.GetPath(), std::ios::binary).write("probe", 5);
+        auto sourceFile = FileDescriptor(::open(source.GetPath().c_str(), O_RDONLY | O_CLOEXEC));
+        auto destinationFile = FileDescriptor(::open(destination.GetPath().c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+        return ::ioctl(destinationFile.Get(), FICLONE, sourceFile.Get()) == 0;
+#else
+        return false;
+#endif
+    }
+}
+
+TEST(CopyToolTestSuite, DedupCopyToolTest)
+{
+    auto index = FileGuard{"dedup_index"};
+    auto indexLock = FileGuard{"dedup_index.lock"};
+    auto source = FileGuard{"dedup_source"};
+    auto firstDestination = FileGuard{"dedup_destination1"};
+    auto secondDestination = FileGuard{"dedup_destination2"};
+    GenerateBinaryFile(source.GetPath(), Mb);
+    CreateDedupCopyTool(CreateSingleThreadedCopyTool(Mb), index.GetPath(), true)->CopyFile(source.GetPath(), firstDestination.GetPath());
+    EXPECT_TRUE(CompareFiles(source.GetPath(), firstDestination.GetPath()));
+    EXPECT_EQ(std::filesystem::hard_link_count(firstDestination.GetPath()), 1u);
+
+    auto copyTool = CreateDedupCopyTool(CreateSingleThreadedCopyTool(Mb), index.GetPath(), true);
+    copyTool->CopyFile(source.GetPath(), secondDestination.GetPath());
+    EXPECT_TRUE(CompareFiles(source.GetPath(), secondDestination.GetPath()));
+    // Without reflinks the second copy falls back to a hard link to the first.
+    auto reflinks = SupportsReflinks();
+    EXPECT_EQ(std::filesystem::equivalent(firstDestination.GetPath(), secondDestination.GetPath()), !reflinks);
+    EXPECT_EQ(std::filesystem::hard_link_count(secondDestination.GetPath()), reflinks ? 1u : 2u);
+
+    // Entries already in the index are not added again.
+    auto indexSize = std::filesystem::file_size(index.GetPath());
+    copyTool->CopyFile(source.GetPath(), secondDestination.GetPath());
+    copyTool->CopyFile(source.GetPath(), std::filesystem::current_path() / secondDestination.GetPath());
+    EXPECT_EQ(std::filesystem::file_size(index.GetPath()), indexSize);
+    EXPECT_EQ(std::filesystem::hard_link_count(secondDestination.GetPath()), reflinks ? 1u : 2u);
+
+    GenerateBinaryFile(source.GetPath(), Mb, 1);
+    copyTool->CopyFile(source.GetPath(), secondDestination.GetPath());
+    EXPECT_TRUE(CompareFiles(source.GetPath(), secondDestination.GetPath()));
+    EXPECT_FALSE(CompareFiles(source.GetPath(), firstDestination.GetPath()));
+    EXPECT_FALSE(std::filesystem::equivalent(firstDestination.GetPath(), secondDestination.GetPath()));
+}
+
+TEST(CopyToolTestSuite, DedupCopyToolMismatchTest)
+{
+    auto index = FileGuard{"dedup_mismatch_index"};
+    auto indexLock = FileGuard{"dedup_mismatch_index.lock"};
+    auto source = FileGuard{"dedup_mismatch_source"};
+    auto firstDestination = FileGuard{"dedup_mismatch_destination1"};
+    auto secondDestination = FileGuard{"dedup_mismatch_destination2"};
+    auto copyTool = CreateDedupCopyTool(CreateSingleThreadedCopyTool(Mb), index.GetPath(), true);
+    GenerateBinaryFile(source.GetPath(), Mb + 16);
+    copyTool->CopyFile(source.GetPath(), firstDestination.GetPath());
+
+    // Same size and same first block, so the index reports the first copy as a candidate.
+    std::fstream(source.GetPath(), std::ios::binary | std::ios::in | std::ios::out).seekp(Mb + 8).write("modified", 8);
+    copyTool->CopyFile(source.GetPath(), secondDestination.GetPath());
+    EXPECT_TRUE(CompareFiles(source.GetPath(), secondDestination.GetPath()));
+    EXPECT_FALSE(CompareFiles(source.GetPath(), firstDestination.GetPath()));
+    EXPECT_FALSE(std::filesystem::equivalent(firstDestination.GetPath(), secondDestination.GetPath()));
+    EXPECT_EQ(std::filesystem::hard_link_count(firstDestination.GetPath()), 1u);
+}
+
+TEST(CopyToolTestSuite, DedupCopyToolIndexGrowthTest)
+{
+    auto index = FileGuard{"dedup_growth_index"};
+    auto indexLock = FileGuard{"dedup_growth_index.lock"};
+    auto source = FileGuard{"dedup_growth_source"};
+    auto destinations = std::vector<FileGuard>();
+    // FileGuard removes its file when destroyed, so the guards must not be reallocated.
+    destinations.reserve(600);
+    // More entries than the initial table holds, so the index is rebuilt while copying.
+    auto copyTool = CreateDedupCopyTool(CreateSingleThreadedCopyTool(Kb), index.GetPath(), true);
+    for (std::size_t i = 0; i < 600; ++i)
+    {
+        GenerateBinaryFile(source.GetPath(), 64, i);
+        destinations.emplace_back("dedup_growth_destination" + std::to_string(i));
+        copyTool->CopyFile(source.GetPath(), destinations.back().GetPath());
+    }
+
+    // A reopened index still finds the early entries.
+    auto copy = FileGuard{"dedup_growth_copy"};
+    GenerateBinaryFile(source.GetPath(), 64, 0);
+    CreateDedupCopyTool(CreateSingleThreadedCopyTool(Kb), index.GetPath(), true)->CopyFile(source.GetPath(), copy.GetPath());
+    EXPECT_TRUE(CompareFiles(source.GetPath(), copy.GetPath()));
+    EXPECT_EQ(std::filesystem::equivalent(destinations.front().GetPath(), copy.GetPath()), !SupportsReflinks());
+}
+
+namespace
+{
+    constexpr auto DedupIndexHeaderSize = std::streamoff{32};
+    constexpr auto DedupIndexSlotSize = std::streamoff{32};
+
+    std::uint64_t ReadDedupEntryCount(const std::filesystem::path &index)
+    {
+        auto file = std::ifstream(index, std::ios::binary);
+        auto entryCount = std::uint64_t{0};
+        file.seekg(16).read(reinterpret_cast<char *>(&entryCount), sizeof(entryCount));
+        return entryCount;
+    }
+}
+
+TEST(CopyToolTestSuite, DedupCopyToolSharedIndexTest)
+{
+    auto index = FileGuard{"dedup_shared_index"};
+    auto indexLock = FileGuard{"dedup_shared_index.lock"};
+    auto source = FileGuard{"dedup_shared_source"};
+    auto copy = FileGuard{"dedup_shared_copy"};
+    auto destinations = std::vector<FileGuard>();
+    destinations.reserve(600);
+    // Both tools map the index, as two processes would; the second one rebuilds it into a new file.
+    auto first = CreateDedupCopyTool(CreateSingleThreadedCopyTool(Kb), index.GetPath(), true);
+    auto second = CreateDedupCopyTool(CreateSingleThreadedCopyTool(Kb), index.GetPath(), true);
+    for (std::size_t i = 0; i < 600; ++i)
+    {
+        GenerateBinaryFile(source.GetPath(), 64, i);
+        destinations.emplace_back("dedup_shared_destination" + std::to_string(i));
+        second->CopyFile(source.GetPath(), destinations.back().GetPath());
+    }
+
+    // The first tool sees the entries of the second and adds its own to the replacement file.
+    GenerateBinaryFile(source.GetPath(), 64, 0);
+    first->CopyFile(source.GetPath(), copy.GetPath());
+    EXPECT_TRUE(CompareFiles(source.GetPath(), copy.GetPath()));
+    EXPECT_EQ(std::filesystem::equivalent(destinations.front().GetPath(), copy.GetPath()), !SupportsReflinks());
+    EXPECT_EQ(ReadDedupEntryCount(index.GetPath()), 601u);
+}
+
+TEST(CopyToolTestSuite, DedupCopyToolCorruptedIndexTest)
+{
+    auto index = FileGuard{"dedup_corrupted_index"};
+    auto indexLock = FileGuard{"dedup_corrupted_index.lock"};
+    auto source = FileGuard{"dedup_corrupted_source"};
+    auto destination = FileGuard{"dedup_corrupted_destination"};
+    GenerateBinaryFile(source.GetPath(), Kb);
+    CreateDedupCopyTool(CreateSingleThreadedCopyTool(Kb), index.GetPath(), true)->CopyFile(source.GetPath(), destination.GetPath());
+
+    // Point the only entry past the end of the path strings.
+    auto file = std::fstream(index.GetPath(), std::ios::binary | std::ios::in | std::ios::out);
+    for (auto slot = DedupIndexHeaderSize; ; slot += DedupIndexSlotSize)
+    {
+        auto used = std::uint32_t{0};
+        ASSERT_TRUE(file.seekg(slot + 28).read(reinterpret_cast<char *>(&used), sizeof(used)));
+        if (used)
         {
-            auto copyTool = CreateTwoThreadedCopyTool(bufferSize);
-            auto destination = FileGuard{"destination"};
-            auto time = measureExecutionTime([&]()
-                                             { copyTool->CopyFile(source.GetPath(), destination.GetPath()); });
-            std::cout << time
-                      << " microseconds to copy file using two threads with buffer "
-                      << std::to_string(bufferSize) << std::endl;
+            auto pathLength = std::numeric_limits<std::uint32_t>::max();
+            file.seekp(slot + 24).write(reinterpret_cast<const char *>(&pathLength), sizeof(pathLength));
+            break;
         }
     }
-    auto copyTool = CreateStlCopyTool();
-    auto destination = FileGuard{"destination"};
+    file.close();
+
+    auto copyTool = CreateDedupCopyTool(CreateSingleThreadedCopyTool(Kb), index.GetPath(), true);
+    EXPECT_THROW(copyTool->CopyFile(source.GetPath(), destination.GetPath()), std::runtime_error);
+}
+
+TEST(CopyToolTestSuite, WritebackOptionsTest)
+{
+    auto source = FileGuard{"writeback_source"};
+    auto destination = FileGuard{"writeback_destination"};
+    GenerateBinaryFile(source.GetPath(), 10 * Mb + 3);
+    for (auto durability : {Durability::None, Durability::FdatasyncAtEnd, Durability::Periodic})
+    {
+        auto writeback = WritebackOptions{};
+        writeback._writeBehindWindow = Mb;
+        writeback._durability = durability;
+        writeback._syncInterval = 4 * Mb;
+
+        CreateSingleThreadedCopyTool(100 * Kb, writeback)->CopyFile(source.GetPath(), destination.GetPath());
+        EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+        CreateTwoThreadedCopyTool(100 * Kb, writeback)->CopyFile(source.GetPath(), destination.GetPath());
+        EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+    }
+}
+
+namespace
+{
+    // Text-like content that compresses well, unlike GenerateBinaryFile output.
+    void GenerateTextFile(const std::filesystem::path &filename, std::size_t fileSize)
+    {
+        auto text = std::string();
+        for (std::size_t line = 0; text.size() < fileSize; ++line)
+        {
+            text += "line " + std::to_string(line) + " of a compressible file\n";
+        }
+        std::ofstream(filename, std::ios::binary).write(text.data(), fileSize);
+    }
+
+    std::string CodecName(CompressionCodec codec)
+    {
+        return codec == CompressionCodec::Lz4 ? "Lz4" : "Zstd";
+    }
+
+    class CompressionTestFixture : public ::testing::TestWithParam<CompressionCodec>
+    {
+    protected:
+        void SetUp() override
+        {
+            if (!IsCodecAvailable(GetParam()))
+            {
+                GTEST_SKIP() << "CopyTool is built without " << CodecName(GetParam());
+            }
+        }
+    };
+}
+
+INSTANTIATE_TEST_SUITE_P(CopyToolTestSuite, CompressionTestFixture, ::testing::Values(CompressionCodec::Lz4, CompressionCodec::Zstd),
+                         [](const ::testing::TestParamInfo<CompressionCodec> &info)
+                         { return CodecName(info.param); });
+
+TEST_P(CompressionTestFixture, CompressionTest)
+{
+    auto source = FileGuard{"compression_source"};
+    auto compressed = FileGuard{"compression_compressed"};
+    auto destination = FileGuard{"compression_destination"};
+    auto compression = CompressionOptions{};
+    compression._codec = GetParam();
+    compression._frameSize = Mb;
+    for (auto compressible : {true, false})
+    {
+        auto fileSize = 10 * Mb + 3;
+        compressible ? GenerateTextFile(source.GetPath(), fileSize) : GenerateBinaryFile(source.GetPath(), fileSize);
+
+        compression._mode = CompressionMode::Compress;
+        CreateTwoThreadedCopyTool(100 * Kb, {}, compression)->CopyFile(source.GetPath(), compressed.GetPath());
+        if (compressible)
+        {
+            EXPECT_LT(std::filesystem::file_size(compressed.GetPath()), fileSize / 2);
+        }
+        else
+        {
+            // Raw frames only add the frame headers, the seek table and the file header and footer.
+            EXPECT_LE(std::filesystem::file_size(compressed.GetPath()), fileSize + 11 * 16 + 40);
+        }
+
+        compression._mode = CompressionMode::Decompress;
+        CreateTwoThreadedCopyTool(100 * Kb, {}, compression)->CopyFile(compressed.GetPath(), destination.GetPath());
+        EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+
+        auto reader = FramedFileReader(compressed.GetPath());
+        EXPECT_EQ(reader.Size(), fileSize);
+        auto expected = std::ifstream(source.GetPath(), std::ios::binary);
+        for (auto offset : {std::uintmax_t{0}, Mb - 5, 7 * Mb + 11, fileSize - 2})
+        {
+            auto expectedData = std::vector<char>(2 * Kb);
+            auto data = std::vector<char>(2 * Kb);
+            expected.clear();
+            expected.seekg(static_cast<std::streamoff>(offset));
+            expected.read(expectedData.data(), expectedData.size());
+            auto length = reader.ReadAt(offset, data.data(), data.size());
+            ASSERT_EQ(length, static_cast<std::size_t>(expected.gcount()));
+            EXPECT_EQ(std::memcmp(data.data(), expectedData.data(), length), 0);
+        }
+    }
+}
+
+TEST_P(CompressionTestFixture, SharedMemoryCompressionTest)
+{
+    auto codec = GetParam();
+    auto source = FileGuard{"shm_compression_source"};
+    auto compressed = FileGuard{"shm_compression_compressed"};
+    auto destination = FileGuard{"shm_compression_destination"};
+    GenerateTextFile(source.GetPath(), 3 * Mb + 5);
+
+    auto options = SharedMemoryOptions{};
+    options._slotSize = 64 * Kb;
+    options._compression._codec = codec;
+    // Both ends of a shared memory pair live in this process, one per thread.
+    auto copy = [&](CompressionMode mode, const std::filesystem::path &from, const std::filesystem::path &to)
+    {
+        options._compression._mode = mode;
+        auto reader = CreateSharedMemoryCopyTool("CopyToolCompressionTest", options);
+        auto writer = CreateSharedMemoryCopyTool("CopyToolCompressionTest", options);
+        auto readerThread = std::jthread([&]()
+                                         { reader->CopyFile(from, to); });
+        writer->CopyFile(from, to);
+    };
+    copy(CompressionMode::Compress, source.GetPath(), compressed.GetPath());
+    EXPECT_LT(std::filesystem::file_size(compressed.GetPath()), std::filesystem::file_size(source.GetPath()));
+    copy(CompressionMode::Decompress, compressed.GetPath(), destination.GetPath());
+    EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+}
+
+TEST_P(CompressionTestFixture, SharedMemoryDecompressionFailureTest)
+{
+    auto source = FileGuard{"shm_failure_source"};
+    auto compressed = FileGuard{"shm_failure_compressed"};
+    auto destination = FileGuard{"shm_failure_destination"};
+    GenerateTextFile(source.GetPath(), 3 * Mb + 5);
+    auto compression = CompressionOptions{};
+    compression._mode = CompressionMode::Compress;
+    compression._codec = GetParam();
+    compression._frameSize = 64 * Kb;
+    CreateTwoThreadedCopyTool(100 * Kb, {}, compression)->CopyFile(source.GetPath(), compressed.GetPath());
+    // The header still announces the whole file, so decoding fails in the middle of the relay.
+    std::filesystem::resize_file(compressed.GetPath(), std::filesystem::file_size(compressed.GetPath()) / 2);
+
+    auto options = SharedMemoryOptions{};
+    options._slotSize = 64 * Kb;
+    options._compression._mode = CompressionMode::Decompress;
+    auto reader = CreateSharedMemoryCopyTool("CopyToolDecompressionFailureTest", options);
+    auto writer = CreateSharedMemoryCopyTool("CopyToolDecompressionFailureTest", options);
+    {
+        auto readerThread = std::jthread([&]()
+                                         {
+            EXPECT_THROW(reader->CopyFile(compressed.GetPath(), destination.GetPath()), std::runtime_error);
+            reader.reset(); });
+        EXPECT_THROW(writer->CopyFile(compressed.GetPath(), destination.GetPath()), std::runtime_error);
+    }
+    EXPECT_FALSE(std::filesystem::exists(destination.GetPath()));
+}
+
+TEST_P(CompressionTestFixture, AsyncDecompressionFailureTest)
+{
+    auto source = FileGuard{"async_failure_source"};
+    auto compressed = FileGuard{"async_failure_compressed"};
+    auto destination = FileGuard{"async_failure_destination"};
+    GenerateTextFile(source.GetPath(), 3 * Mb + 5);
+    auto compression = CompressionOptions{};
+    compression._mode = CompressionMode::Compress;
+    compression._codec = GetParam();
+    compression._frameSize = 64 * Kb;
+    CreateTwoThreadedCopyTool(100 * Kb, {}, compression)->CopyFile(source.GetPath(), compressed.GetPath());
+    // The header still announces the whole file, so decoding fails after some chunks are written.
+    std::filesystem::resize_file(compressed.GetPath(), std::filesystem::file_size(compressed.GetPath()) / 2);
+
+    compression._mode = CompressionMode::Decompress;
+    auto future = CreateTwoThreadedCopyTool(100 * Kb, {}, compression)->CopyFileAsync(compressed.GetPath(), destination.GetPath());
+    EXPECT_THROW(future.get(), std::runtime_error);
+    EXPECT_FALSE(std::filesystem::exists(destination.GetPath()));
+}
+
+namespace
+{
+    // Counts the files that reach it.
+    class CountingCopyTool : public ICopyTool
+    {
+    public:
+        explicit CountingCopyTool(std::shared_ptr<std::size_t> count) : _count{std::move(count)} {}
+
+        void CopyFile(const std::filesystem::path &source, const std::filesystem::path &destination) override
+        {
+            ++*_count;
+            std::filesystem::copy_file(source, destination, std::filesystem::copy_options::overwrite_existing);
+        }
+
+    private:
+        std::shared_ptr<std::size_t> _count;
+    };
+}
+
+TEST(CopyToolTestSuite, SmallFileCopyTest)
+{
+    auto source = FileGuard{"small_source"};
+    auto destination = FileGuard{"small_destination"};
+    GenerateBinaryFile(source.GetPath(), 4 * Kb + 3, 7);
+
+    auto length = TryCopySmallFile(source.GetPath(), destination.GetPath(), 8 * Kb, WritebackOptions{}, IoPriority::Foreground);
+    ASSERT_TRUE(length);
+    EXPECT_EQ(*length, 4 * Kb + 3);
+    EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+    // A second copy reuses the thread-local buffer and replaces the destination.
+    std::filesystem::resize_file(source.GetPath(), 5);
+    EXPECT_EQ(TryCopySmallFile(source.GetPath(), destination.GetPath(), 8 * Kb, WritebackOptions{}, IoPriority::Foreground), 5u);
+    EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+
+    // Larger files, directories and missing files are left to the regular path untouched.
+    std::filesystem::remove(destination.GetPath());
+    EXPECT_FALSE(TryCopySmallFile(source.GetPath(), destination.GetPath(), 4, WritebackOptions{}, IoPriority::Foreground));
+    EXPECT_FALSE(TryCopySmallFile(".", destination.GetPath(), 8 * Kb, WritebackOptions{}, IoPriority::Foreground));
+    EXPECT_FALSE(TryCopySmallFile("small_missing", destination.GetPath(), 8 * Kb, WritebackOptions{}, IoPriority::Foreground));
+    EXPECT_FALSE(std::filesystem::exists(destination.GetPath()));
+
+    // The wrapper the buffered factories use hands only files over its limit to the wrapped tool.
+    auto counted = std::make_shared<std::size_t>(0);
+    auto wrapper = CreateSmallFileCopyTool(std::make_unique<CountingCopyTool>(counted), 8 * Kb, WritebackOptions{}, IoPriority::Foreground);
+    for (auto size : {std::size_t{0}, 8 * Kb})
+    {
+        std::filesystem::resize_file(source.GetPath(), size);
+        wrapper->CopyFile(source.GetPath(), destination.GetPath());
+        EXPECT_EQ(std::filesystem::file_size(destination.GetPath()), size);
+    }
+    EXPECT_EQ(*counted, 0u);
+    std::filesystem::resize_file(source.GetPath(), 8 * Kb + 1);
+    wrapper->CopyFile(source.GetPath(), destination.GetPath());
+    EXPECT_EQ(std::filesystem::file_size(destination.GetPath()), 8 * Kb + 1);
+    EXPECT_EQ(*counted, 1u);
+}
+
+TEST(CopyToolTestSuite, SharedMemorySmallFileTest)
+{
+    auto source = FileGuard{"shm_small_source"};
+    auto destination = FileGuard{"shm_small_destination"};
+    GenerateBinaryFile(source.GetPath(), 700, 3);
+    for (auto smallFileCopy : {true, false})
+    {
+        auto options = SharedMemoryOptions{};
+        options._smallFileCopy = smallFileCopy;
+        // Both ends of a shared memory pair live in this process, one per thread.
+        auto reader = CreateSharedMemoryCopyTool("CopyToolSmallFileTest", options);
+        auto writer = CreateSharedMemoryCopyTool("CopyToolSmallFileTest", options);
+        {
+            auto readerThread = std::jthread([&]()
+                                             { reader->CopyFile(source.GetPath(), destination.GetPath()); });
+            writer->CopyFile(source.GetPath(), destination.GetPath());
+        }
+        EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+        std::filesystem::remove(destination.GetPath());
+    }
+}
+
+namespace
+{
+    // The scheduler is process-wide, so every test leaves it unlimited.
+    class IoSchedulerReset
+    {
+    public:
+        ~IoSchedulerReset()
+        {
+            IoScheduler::Instance().SetLimits({});
+            IoScheduler::Instance().SetForegroundLatencyTarget(std::chrono::microseconds(0));
+        }
+    };
+}
+
+TEST(CopyToolTestSuite, IoSchedulerLimitsTest)
+{
+    auto reset = IoSchedulerReset{};
+    auto source = FileGuard{"scheduler_source"};
+    auto destination = FileGuard{"scheduler_destination"};
+    GenerateBinaryFile(source.GetPath(), 10 * Mb);
+
+    // 10 Mb are read and written, 20 Mb of tokens at 20 Mb/s: 900 ms once the 100 ms burst is spent.
+    // A loaded machine only makes the copy slower, so the lower bound keeps its slack for timer jitter.
+    IoScheduler::Instance().SetLimits(IoLimits{20 * Mb, 0});
+    for (auto &copyTool : {CreateSingleThreadedCopyTool(Mb), CreateStlCopyTool()})
+    {
+        auto time = measureExecutionTime([&]()
+                                         { copyTool->CopyFile(source.GetPath(), destination.GetPath()); });
+        EXPECT_GE(time, 700'000);
+        EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+    }
+
+    // 200 operations at 10 per second would take 20 seconds; lifting the limit releases the copy.
+    IoScheduler::Instance().SetLimits(IoLimits{0, 10});
+    auto future = CreateTwoThreadedCopyTool(100 * Kb)->CopyFileAsync(source.GetPath(), destination.GetPath());
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    IoScheduler::Instance().SetLimits({});
+    EXPECT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    future.get();
+    EXPECT_TRUE(CompareFiles(source.GetPath(), destination.GetPath()));
+}
+
+TEST(CopyToolTestSuite, IoSchedulerPriorityTest)
+{
+    auto reset = IoSchedulerReset{};
+    auto &scheduler = IoScheduler::Instance();
+    // Every grant waits about 10 ms, far longer than a thread needs to queue up again, so the order
+    // of the grants shows the priorities without depending on how fast the machine is.
+    scheduler.SetLimits(IoLimits{0, 100});
+    auto mutex = std::mutex();
+    auto grants = std::string();
+    auto acquire = [&](IoPriority priority, std::size_t count, char tag)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            scheduler.Acquire(priority, Kb);
+            auto lock = std::lock_guard(mutex);
+            grants += tag;
+        }
+    };
+    {
+        auto backgroundThread = std::jthread(acquire, IoPriority::Background, 40, 'b');
+        auto grantCount = [&]()
+        {
+            auto lock = std::lock_guard(mutex);
+            return grants.size();
+        };
+        while (grantCount() < 5)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        acquire(IoPriority::Foreground, 20, 'f');
+    }
+    // Once the foreground operations queue up they go first; a descheduled test thread may let a
+    // background operation slip in.
+    auto first = grants.find('f');
+    auto last = grants.rfind('f');
+    ASSERT_NE(first, std::string::npos);
+    EXPECT_LE(std::count(grants.begin() + first, grants.begin() + last, 'b'), 2);
+    EXPECT_EQ(std::count(grants.begin(), grants.end(), 'b'), 40);
+}
+
+TEST(CopyToolTestSuite, IoSchedulerAsyncPriorityTest)
+{
+    auto reset = IoSchedulerReset{};
+    auto source = FileGuard{"async_priority_source"};
+    auto foregroundDestination = FileGuard{"async_priority_foreground"};
+    auto backgroundDestinations = std::vector<FileGuard>();
+    backgroundDestinations.reserve(4);
+    GenerateBinaryFile(source.GetPath(), 4 * Mb);
+
+    // The background copies need 32 Mb of tokens at 8 Mb/s, more jobs than the executor has threads.
+    IoScheduler::Instance().SetLimits(IoLimits{8 * Mb, 0});
+    auto background = CreateSingleThreadedCopyTool(256 * Kb, {}, IoPriority::Background);
+    auto stopSource = std::stop_source{};
+    auto backgroundFutures = std::vector<std::future<void>>();
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        backgroundDestinations.emplace_back("async_priority_background" + std::to_string(i));
+        backgroundFutures.push_back(background->CopyFileAsync(source.GetPath(), backgroundDestinations.back().GetPath(), {},
+                                                              stopSource.get_token()));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Waiting jobs do not hold executor threads, so the foreground copy needs its own 8 Mb of tokens only.
+    auto foreground = CreateSingleThreadedCopyTool(256 * Kb);
     auto time = measureExecutionTime([&]()
-                                     { copyTool->CopyFile(source.GetPath(), destination.GetPath()); });
-    std::cout << time
-              << " microseconds to copy file using stl" << std::endl;
-}
\ No newline at end of file
+                                     { foreground->CopyFileAsync(source.GetPath(), foregroundDestination.GetPath()).get(); });
+    EXPECT_LT(time, 2'500'000);
+    EXPECT_TRUE(CompareFiles(source.GetPath(), foregroundDestination.GetPath()));
+
+    stopSource.request_stop();
+    for (auto &future : backgroundFutures)
+    {
+        ASSERT_EQ(future.wait_for(std::chrono::milliseconds(500)), std::future_status::ready);
+        EXPECT_THROW(future.get(), CopyCancelledError);
+    }
+}
+
+TEST(CopyToolTestSuite, IoSchedulerLatencyTargetTest)
+{
+    auto reset = IoSchedulerReset{};
+    auto &scheduler = IoScheduler::Instance();
+    // Feeds background traffic and foreground samples until the scheduler closes its control window.
+    auto runWindow = [&](std::chrono::nanoseconds foregroundLatency)
+    {
+        auto rate = scheduler.GetBackgroundRate();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (scheduler.GetBackgroundRate() == rate && std::chrono::steady_clock::now() < deadline)
+        {
+            scheduler.Acquire(IoPriority::Background, 64 * Kb);
+            scheduler.ReportLatency(IoPriority::Foreground, foregroundLatency);
+        }
+    };
+
+    scheduler.SetForegroundLatencyTarget(std::chrono::microseconds(500));
+    EXPECT_EQ(scheduler.GetBackgroundRate(), 0u);
+    runWindow(std::chrono::milliseconds(2));
+    auto cappedRate = scheduler.GetBackgroundRate();
+    EXPECT_NE(cappedRate, 0u);
+
+    runWindow(std::chrono::microseconds(100));
+    auto recoveredRate = scheduler.GetBackgroundRate();
+    EXPECT_TRUE(recoveredRate == 0 || recoveredRate > cappedRate);
+
+    scheduler.SetForegroundLatencyTarget(std::chrono::microseconds(0));
+    EXPECT_EQ(scheduler.GetBackgroundRate(), 0u);
+}
@@ -13,19 +13,62 @@ namespace
     constexpr auto SourceOption = "source"sv;
     constexpr auto DestinationOption = "destination"sv;
     constexpr auto SharedMemoryNameOption = "shared_memory"sv;
-}
+    constexpr auto SlotSizeOption = "slot_size"sv;
+    constexpr auto InjectFailureOption = "inject_failure"sv;
+    constexpr auto TransportOption = "transport"sv;
+    constexpr auto SharedMemoryTransport = "shared_memory"sv;
+    constexpr auto FdPassingTransport = "fd_passing"sv;
+    constexpr auto CompressionOption = "compression"sv;
+    constexpr auto BackgroundOption = "background"sv;
+    constexpr auto BytesPerSecondOption = "bytes_per_second"sv;
+    constexpr auto OperationsPerSecondOption = "ops_per_second"sv;
+    constexpr auto LatencyTargetOption = "p99_target_us"sv;
+    constexpr auto NoSmallFileCopyOption = "no_small_file_copy"sv;
+    constexpr auto SyncOption = "sync"sv;
+    constexpr auto WriteBehindOption = "write_behind"sv;
+    constexpr auto SyncIntervalOption = "sync_interval"sv;
 
-namespace po = boost::program_options;
+    std::optional<Compression> ParseCompression(std::string_view value)
+    {
+        if (value == "none"sv)
+        {
+            return Compression::None;
+        }
+        if (value == "lz4"sv)
+        {
+            return Compression::Lz4;
+        }
+        if (value == "zstd"sv)
+        {
+            return Compression::Zstd;
+        }
+        if (value == "decompress"sv)
+        {
+            return Compression::Decompress;
+        }
+        return std::nullopt;
+    }
 
-ProgramOptions::ProgramOptions(std::filesystem::path source,
-                               std::filesystem::path destination,
-                               std::string sharedMemoryName)
-    : _source{std::move(source)},
-      _destination{std::move(destination)},
-      _sharedMemoryName(std::move(sharedMemoryName))
-{
+    std::optional<SyncMode> ParseSyncMode(std::string_view value)
+    {
+        if (value == "none"sv)
+        {
+            return SyncMode::None;
+        }
+        if (value == "at_end"sv)
+        {
+            return SyncMode::AtEnd;
+        }
+        if (value == "periodic"sv)
+        {
+            return SyncMode::Periodic;
+        }
+        return std::nullopt;
+    }
 }
 
+namespace po = boost::program_options;
+
 std::optional<ProgramOptions> ProgramOptions::ParseProgramOptions(std::vector<std::string> commandLine)
 {
     po::options_description commonOptions("Common options");
@@ -35,7 +78,19 @@ std::optional<ProgramOptions> ProgramOptions::ParseProgramOptions(std::vector<st
     options.add_options()
     (SourceOption.data(), po::value<std::filesystem::path>()->required(), "Source file path")
     (DestinationOption.data(), po::value<std::filesystem::path>()->required(), "Destination file path")
-    (SharedMemoryNameOption.data(), po::value<std::string>()->required(), "Shared memory name");
+    (SharedMemoryNameOption.data(), po::value<std::string>()->required(), "Shared memory name, also names the fd passing session")
+    (SlotSizeOption.data(), po::value<std::size_t>()->default_value(1024), "Size of each shared memory buffer, must match for both processes")
+    (InjectFailureOption.data(), po::bool_switch(), "Throw in the reader after the first block is relayed")
+    (TransportOption.data(), po::value<std::string>()->default_value(SharedMemoryTransport.data()), "Cross-process transport: shared_memory or fd_passing")
+    (CompressionOption.data(), po::value<std::string>()->default_value("none"), "Shared memory transport only: none, lz4 or zstd to write the destination compressed, decompress to restore a compressed source")
+    (BackgroundOption.data(), po::bool_switch(), "Schedule the copy behind foreground I/O of this process")
+    (BytesPerSecondOption.data(), po::value<std::uint64_t>()->default_value(0), "Read and write bandwidth limit, 0 for none")
+    (OperationsPerSecondOption.data(), po::value<std::uint64_t>()->default_value(0), "Read and write operation limit, 0 for none")
+    (LatencyTargetOption.data(), po::value<std::uint64_t>()->default_value(0), "Slow background I/O down while the p99 operation latency exceeds this many microseconds, 0 for no target")
+    (NoSmallFileCopyOption.data(), po::bool_switch(), "Send every file through the transport, including small files the first process would copy on its own")
+    (SyncOption.data(), po::value<std::string>()->default_value("none"), "Synchronize the destination to the disk: none, at_end, or periodic every sync_interval bytes and at the end")
+    (WriteBehindOption.data(), po::value<std::size_t>()->default_value(0), "Push written data to the disk this many bytes behind the write position and drop it from the page cache, 0 leaves writeback to the kernel")
+    (SyncIntervalOption.data(), po::value<std::size_t>()->default_value(256 * 1024 * 1024), "Bytes written between two synchronizations of the periodic sync");
     // clang-format on
     auto printHelpMessage = [&]()
     {
@@ -54,9 +109,51 @@ std::optional<ProgramOptions> ProgramOptions::ParseProgramOptions(std::vector<st
         }
         po::store(po::command_line_parser(commandLine).options(options).run(), vm);
         po::notify(vm);
-        return ProgramOptions(vm[SourceOption.data()].as<std::filesystem::path>(),
-                              vm[DestinationOption.data()].as<std::filesystem::path>(),
-                              vm[SharedMemoryNameOption.data()].as<std::string>());
+        auto transport = vm[TransportOption.data()].as<std::string>();
+        if (transport != SharedMemoryTransport && transport != FdPassingTransport)
+        {
+            throw po::validation_error(po::validation_error::invalid_option_value, TransportOption.data(), transport);
+        }
+        auto compression = ParseCompression(vm[CompressionOption.data()].as<std::string>());
+        if (!compression)
+        {
+            throw po::validation_error(po::validation_error::invalid_option_value, CompressionOption.data(),
+                                       vm[CompressionOption.data()].as<std::string>());
+        }
+        if (transport == FdPassingTransport && *compression != Compression::None)
+        {
+            throw po::error("the option '--compression' requires the shared_memory transport");
+        }
+        auto sync = ParseSyncMode(vm[SyncOption.data()].as<std::string>());
+        if (!sync)
+        {
+            throw po::validation_error(po::validation_error::invalid_option_value, SyncOption.data(),
+                                       vm[SyncOption.data()].as<std::string>());
+        }
+        if (vm[SlotSizeOption.data()].as<std::size_t>() == 0)
+        {
+            throw po::validation_error(po::validation_error::invalid_option_value, SlotSizeOption.data(), "0");
+        }
+        if (vm[SyncIntervalOption.data()].as<std::size_t>() == 0)
+        {
+            throw po::validation_error(po::validation_error::invalid_option_value, SyncIntervalOption.data(), "0");
+        }
+        return ProgramOptions{
+            ._source = vm[SourceOption.data()].as<std::filesystem::path>(),
+            ._destination = vm[DestinationOption.data()].as<std::filesystem::path>(),
+            ._sharedMemoryName = vm[SharedMemoryNameOption.data()].as<std::string>(),
+            ._slotSize = vm[SlotSizeOption.data()].as<std::size_t>(),
+            ._injectFailure = vm[InjectFailureOption.data()].as<bool>(),
+            ._transport = transport == FdPassingTransport ? Transport::FdPassing : Transport::SharedMemory,
+            ._compression = *compression,
+            ._background = vm[BackgroundOption.data()].as<bool>(),
+            ._bytesPerSecond = vm[BytesPerSecondOption.data()].as<std::uint64_t>(),
+            ._operationsPerSecond = vm[OperationsPerSecondOption.data()].as<std::uint64_t>(),
+            ._latencyTargetUs = vm[LatencyTargetOption.data()].as<std::uint64_t>(),
+            ._smallFileCopy = !vm[NoSmallFileCopyOption.data()].as<bool>(),
+            ._sync = *sync,
+            ._writeBehindWindow = vm[WriteBehindOption.data()].as<std::size_t>(),
+            ._syncInterval = vm[SyncIntervalOption.data()].as<std::size_t>()};
     }
     catch (std::exception &e)
     {
@@ -1,16 +1,53 @@
 #pragma once
+#include <cstdint>
 #include <filesystem>
 #include <optional>
+#include <string>
 #include <vector>
 
-class ProgramOptions
+enum class Transport
 {
-public:
-    static std::optional<ProgramOptions> ParseProgramOptions(std::vector<std::string> commandLine);
+    SharedMemory,
+    FdPassing
+};
+
+// Compression stage of the shared memory transport.
+enum class Compression
+{
+    None,
+    Lz4,
+    Zstd,
+    Decompress
+};
 
-    ProgramOptions(std::filesystem::path source, std::filesystem::path destination, std::string sharedMemoryName);
+// When the destination is synchronized to the disk.
+enum class SyncMode
+{
+    None,
+    AtEnd,
+    Periodic
+};
+
+struct ProgramOptions
+{
+    static std::optional<ProgramOptions> ParseProgramOptions(std::vector<std::string> commandLine);
 
     std::filesystem::path _source;
     std::filesystem::path _destination;
     std::string _sharedMemoryName;
+    std::size_t _slotSize = 1024;
+    bool _injectFailure = false;
+    Transport _transport = Transport::SharedMemory;
+    Compression _compression = Compression::None;
+    // I/O scheduling of this process; zero limits and target turn the corresponding control off.
+    bool _background = false;
+    std::uint64_t _bytesPerSecond = 0;
+    std::uint64_t _operationsPerSecond = 0;
+    std::uint64_t _latencyTargetUs = 0;
+    // Lets the first process copy small files on its own, skipping the transport.
+    bool _smallFileCopy = true;
+    // Writeback of the destination; a zero window leaves it to the kernel.
+    SyncMode _sync = SyncMode::None;
+    std::size_t _writeBehindWindow = 0;
+    std::size_t _syncInterval = 256 * 1024 * 1024;
 };
\ No newline at end of file
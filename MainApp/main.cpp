@@ -1,5 +1,6 @@
 #include <MainApp/ProgramOptions.h>
-#include <CopyTool/ICopyTool.h>
+#include <CopyTool/IoScheduler.h>
+#include <exception>
 #include <string>
 #include <iostream>
 
@@ -7,7 +8,7 @@ ICopyToolPtrU copyTool = nullptr;
 
 int main(int argc, char **argv)
 {
-    set_terminate([]()
+    std::set_terminate([]()
                   {std::cout << "Custom termination function called" << std::endl;if(copyTool){
                     copyTool.reset();
         
@@ -18,7 +19,51 @@ int main(int argc, char **argv)
     {
         return 0;
     }
-    copyTool = CreateSharedMemoryCopyTool(programOptions->_sharedMemoryName);
-    copyTool->CopyFile(programOptions->_source, programOptions->_destination);
+    IoScheduler::Instance().SetLimits(IoLimits{programOptions->_bytesPerSecond, programOptions->_operationsPerSecond});
+    IoScheduler::Instance().SetForegroundLatencyTarget(std::chrono::microseconds(programOptions->_latencyTargetUs));
+    auto priority = programOptions->_background ? IoPriority::Background : IoPriority::Foreground;
+    auto writeback = WritebackOptions{};
+    writeback._writeBehindWindow = programOptions->_writeBehindWindow;
+    writeback._syncInterval = programOptions->_syncInterval;
+    if (programOptions->_sync == SyncMode::AtEnd)
+    {
+        writeback._durability = Durability::FdatasyncAtEnd;
+    }
+    else if (programOptions->_sync == SyncMode::Periodic)
+    {
+        writeback._durability = Durability::Periodic;
+    }
+    if (programOptions->_transport == Transport::FdPassing)
+    {
+        copyTool = CreateFdPassingCopyTool(programOptions->_sharedMemoryName, writeback, priority, programOptions->_smallFileCopy);
+    }
+    else
+    {
+        auto options = SharedMemoryOptions{};
+        options._slotSize = programOptions->_slotSize;
+        options._injectFailure = programOptions->_injectFailure;
+        options._priority = priority;
+        options._smallFileCopy = programOptions->_smallFileCopy;
+        options._writeback = writeback;
+        if (programOptions->_compression == Compression::Decompress)
+        {
+            options._compression._mode = CompressionMode::Decompress;
+        }
+        else if (programOptions->_compression != Compression::None)
+        {
+            options._compression._mode = CompressionMode::Compress;
+            options._compression._codec = programOptions->_compression == Compression::Lz4 ? CompressionCodec::Lz4 : CompressionCodec::Zstd;
+        }
+        copyTool = CreateSharedMemoryCopyTool(programOptions->_sharedMemoryName, options);
+    }
+    try
+    {
+        copyTool->CopyFile(programOptions->_source, programOptions->_destination);
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
@@ -26,12 +26,29 @@ namespace
     constexpr auto DestinationFilePath = "dest.txt"sv;
     constexpr auto SharedMemoryOption = "--shared_memory"sv;
     constexpr auto SharedMemoryName = "SharedMemory"sv;
+    constexpr auto SlotSizeOption = "--slot_size"sv;
+    constexpr auto SlotSize = "4096"sv;
+    constexpr auto InjectFailureOption = "--inject_failure"sv;
+    constexpr auto TransportOption = "--transport"sv;
+    constexpr auto CompressionOption = "--compression"sv;
+    constexpr auto BackgroundOption = "--background"sv;
+    constexpr auto BytesPerSecondOption = "--bytes_per_second"sv;
+    constexpr auto OperationsPerSecondOption = "--ops_per_second"sv;
+    constexpr auto LatencyTargetOption = "--p99_target_us"sv;
+    constexpr auto NoSmallFileCopyOption = "--no_small_file_copy"sv;
+    constexpr auto SyncOption = "--sync"sv;
+    constexpr auto WriteBehindOption = "--write_behind"sv;
+    constexpr auto SyncIntervalOption = "--sync_interval"sv;
 }
 
 bool operator==(const ProgramOptions &lhs, const ProgramOptions &rhs)
 {
-    return std::tie(lhs._source, lhs._destination, lhs._sharedMemoryName) ==
-           std::tie(rhs._source, rhs._destination, rhs._sharedMemoryName);
+    return std::tie(lhs._source, lhs._destination, lhs._sharedMemoryName, lhs._slotSize, lhs._injectFailure, lhs._transport, lhs._compression,
+                    lhs._background, lhs._bytesPerSecond, lhs._operationsPerSecond, lhs._latencyTargetUs, lhs._smallFileCopy,
+                    lhs._sync, lhs._writeBehindWindow, lhs._syncInterval) ==
+           std::tie(rhs._source, rhs._destination, rhs._sharedMemoryName, rhs._slotSize, rhs._injectFailure, rhs._transport, rhs._compression,
+                    rhs._background, rhs._bytesPerSecond, rhs._operationsPerSecond, rhs._latencyTargetUs, rhs._smallFileCopy,
+                    rhs._sync, rhs._writeBehindWindow, rhs._syncInterval);
 }
 
 // clang-format off
@@ -47,7 +64,23 @@ INSTANTIATE_TEST_SUITE_P(ProgramOptionsTestSuite, ProgramOptionsTestFixture, ::t
     TestParams{{SourceOption.data(), SourceFilePath.data()}, std::nullopt, "the option '--destination' is required but missing"},
     TestParams{{SourceOption.data(), SourceFilePath.data(), HelpOption.data()}, std::nullopt, HelpScreen.data()},
     TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), HelpOption.data()}, std::nullopt, HelpScreen.data()},
-    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data()}, ProgramOptions{SourceFilePath, DestinationFilePath, SharedMemoryName.data()}, ""}
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data()}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data()}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), SlotSizeOption.data(), SlotSize.data(), InjectFailureOption.data()}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data(), ._slotSize = 4096, ._injectFailure = true}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), SlotSizeOption.data()}, std::nullopt, "the required argument for option '--slot_size' is missing"},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), TransportOption.data(), "fd_passing"}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data(), ._transport = Transport::FdPassing}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), TransportOption.data(), "pipe"}, std::nullopt, "the argument for option 'transport' is invalid"},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), CompressionOption.data(), "zstd"}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data(), ._compression = Compression::Zstd}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), CompressionOption.data(), "decompress"}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data(), ._compression = Compression::Decompress}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), CompressionOption.data(), "gzip"}, std::nullopt, "the argument for option 'compression' is invalid"},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), TransportOption.data(), "fd_passing", CompressionOption.data(), "lz4"}, std::nullopt, "the option '--compression' requires the shared_memory transport"},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), BackgroundOption.data(), BytesPerSecondOption.data(), "1048576", OperationsPerSecondOption.data(), "100", LatencyTargetOption.data(), "5000"}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data(), ._background = true, ._bytesPerSecond = 1048576, ._operationsPerSecond = 100, ._latencyTargetUs = 5000}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), NoSmallFileCopyOption.data()}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data(), ._smallFileCopy = false}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), SyncOption.data(), "periodic", WriteBehindOption.data(), "8388608", SyncIntervalOption.data(), "67108864"}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data(), ._sync = SyncMode::Periodic, ._writeBehindWindow = 8388608, ._syncInterval = 67108864}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), SyncOption.data(), "at_end"}, ProgramOptions{._source = SourceFilePath, ._destination = DestinationFilePath, ._sharedMemoryName = SharedMemoryName.data(), ._sync = SyncMode::AtEnd}, ""},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), SyncOption.data(), "always"}, std::nullopt, "the argument for option 'sync' is invalid"},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), SlotSizeOption.data(), "0"}, std::nullopt, "the argument for option 'slot_size' is invalid"},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), SyncIntervalOption.data(), "0"}, std::nullopt, "the argument for option 'sync_interval' is invalid"},
+    TestParams{{SourceOption.data(), SourceFilePath.data(), DestinationOption.data(), DestinationFilePath.data(), SharedMemoryOption.data(), SharedMemoryName.data(), BytesPerSecondOption.data(), "fast"}, std::nullopt, "the argument ('fast') for option '--bytes_per_second' is invalid"}
 ));
 // clang-format on
 
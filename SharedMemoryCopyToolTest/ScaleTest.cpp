@@ -0,0 +1,440 @@
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/process.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+namespace bp = boost::process;
+namespace po = boost::program_options;
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    enum class CrashKind
+    {
+        None,
+        // The harness kills the reader, respectively the writer, in the middle of a throttled copy.
+        KillReader,
+        KillWriter,
+        // The reader throws after relaying its first block (copyTool --inject_failure).
+        Exception
+    };
+
+    // Slow enough that a killed pair cannot finish the copy before the kill lands.
+    constexpr auto KilledPairOperationsPerSecond = "2";
+    constexpr auto KillDelay = 100ms;
+    constexpr auto RoleTimeout = 5s;
+
+    bool IsKill(CrashKind crashKind)
+    {
+        return crashKind == CrashKind::KillReader || crashKind == CrashKind::KillWriter;
+    }
+
+    std::string ToString(CrashKind crashKind)
+    {
+        switch (crashKind)
+        {
+        case CrashKind::KillReader:
+            return "kill_reader";
+        case CrashKind::KillWriter:
+            return "kill_writer";
+        case CrashKind::Exception:
+            return "exception";
+        default:
+            return "none";
+        }
+    }
+
+    struct Settings
+    {
+        std::filesystem::path _copyTool;
+        std::filesystem::path _workDir;
+        std::vector<std::size_t> _pairCounts;
+        std::vector<std::size_t> _fileSizes;
+        std::vector<std::size_t> _slotSizes;
+        std::vector<std::string> _transports;
+        std::size_t _crashEvery;
+        std::chrono::seconds _timeout;
+        std::chrono::seconds _crashTimeout;
+    };
+
+    struct Pair
+    {
+        std::string _sharedMemoryName;
+        std::filesystem::path _destination;
+        CrashKind _crashKind = CrashKind::None;
+        // Crashed pairs run the reader first and the writer second, each logging to its own file.
+        std::vector<bp::child> _processes;
+        std::vector<std::filesystem::path> _logs;
+        Clock::time_point _start;
+        // When the writer of a crashed pair announced its role.
+        Clock::time_point _established;
+        Clock::time_point _crashDeadline;
+        std::optional<Clock::time_point> _finish;
+        // The pair did not reach the crash the harness meant to inject.
+        bool _crashMissed = false;
+    };
+
+    struct Summary
+    {
+        std::size_t _failures = 0;
+    };
+
+    void GenerateFile(const std::filesystem::path &path, std::size_t size)
+    {
+        auto buffer = std::vector<char>(size);
+        auto state = std::uint64_t{size};
+        for (std::size_t i = 0; i < size; i += sizeof(std::uint64_t))
+        {
+            state += 0x9E3779B97F4A7C15ull;
+            auto word = state;
+            word = (word ^ (word >> 30)) * 0xBF58476D1CE4E5B9ull;
+            word = (word ^ (word >> 27)) * 0x94D049BB133111EBull;
+            word ^= word >> 31;
+            std::memcpy(buffer.data() + i, &word, std::min(sizeof(word), size - i));
+        }
+        std::ofstream(path, std::ios::binary).write(buffer.data(), buffer.size());
+    }
+
+    bool EqualFiles(const std::filesystem::path &lhs, const std::filesystem::path &rhs)
+    {
+        if (!std::filesystem::exists(rhs) || std::filesystem::file_size(lhs) != std::filesystem::file_size(rhs))
+        {
+            return false;
+        }
+        auto lhsFile = std::ifstream(lhs, std::ios::binary);
+        auto rhsFile = std::ifstream(rhs, std::ios::binary);
+        return std::equal(std::istreambuf_iterator<char>(lhsFile), std::istreambuf_iterator<char>(),
+                          std::istreambuf_iterator<char>(rhsFile));
+    }
+
+    // The copyTool prints its role once it has joined the session.
+    bool WaitForOutput(const std::filesystem::path &log, std::string_view text, Clock::time_point deadline)
+    {
+        while (Clock::now() < deadline)
+        {
+            auto file = std::ifstream(log);
+            auto output = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            if (output.find(text) != std::string::npos)
+            {
+                return true;
+            }
+            std::this_thread::sleep_for(1ms);
+        }
+        return false;
+    }
+
+    // boost::process reaps a terminated child only when it has already exited, and a zombie
+    // still passes the survivor's liveness check, so the victim is reaped here.
+    void Kill(bp::child &process)
+    {
+#ifdef _WIN32
+        process.terminate();
+#else
+        ::kill(process.id(), SIGKILL);
+        process.wait();
+#endif
+    }
+
+    double Percentile(std::vector<double> values, double percentile)
+    {
+        if (values.empty())
+        {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        auto rank = static_cast<std::size_t>(percentile / 100.0 * static_cast<double>(values.size()) + 0.5);
+        return values[std::clamp<std::size_t>(rank, 1, values.size()) - 1];
+    }
+
+    bp::child Launch(const Settings &settings, const std::filesystem::path &source, const Pair &pair, std::size_t slotSize,
+                     const std::string &transport, const std::optional<std::filesystem::path> &log = std::nullopt)
+    {
+        auto args = std::vector<std::string>{
+            "--source", source.string(),
+            "--destination", pair._destination.string(),
+            "--shared_memory", pair._sharedMemoryName,
+            "--slot_size", std::to_string(slotSize),
+            "--transport", transport,
+            // The harness measures the transports, which small files would otherwise skip.
+            "--no_small_file_copy"};
+        if (pair._crashKind == CrashKind::Exception)
+        {
+            args.push_back("--inject_failure");
+        }
+        if (IsKill(pair._crashKind))
+        {
+            args.insert(args.end(), {"--ops_per_second", KilledPairOperationsPerSecond});
+        }
+        if (log)
+        {
+            return bp::child(settings._copyTool.string(), bp::args(args), bp::std_out > log->string(), bp::std_err > bp::null);
+        }
+        return bp::child(settings._copyTool.string(), bp::args(args), bp::std_out > bp::null, bp::std_err > bp::null);
+    }
+
+    // Starts the reader before the writer, so the harness knows which process plays which role.
+    void LaunchCrashedPair(const Settings &settings, const std::filesystem::path &source, Pair &pair, std::size_t slotSize,
+                           const std::string &transport)
+    {
+        auto deadline = Clock::now() + RoleTimeout;
+        for (auto role : {"Mode: Reader", "Mode: Writer"})
+        {
+            auto log = std::filesystem::path(pair._destination.string() + "_" + std::to_string(pair._logs.size()) + ".log");
+            pair._logs.push_back(log);
+            pair._processes.push_back(Launch(settings, source, pair, slotSize, transport, log));
+            if (!WaitForOutput(log, role, deadline))
+            {
+                pair._crashMissed = true;
+                return;
+            }
+        }
+        pair._established = Clock::now();
+    }
+
+    // Runs pairCount concurrent reader/writer pairs, each on its own shared memory segment or socket,
+    // and reports per-pair throughput and end-to-end latency percentiles.
+    void RunConfiguration(const Settings &settings, const std::string &transport, std::size_t pairCount, std::size_t fileSize,
+                          std::size_t slotSize, Summary &summary)
+    {
+        auto prefix = "scale_" + transport + "_" + std::to_string(pairCount) + "_" + std::to_string(fileSize) + "_" + std::to_string(slotSize);
+        auto source = settings._workDir / (prefix + "_source");
+        GenerateFile(source, fileSize);
+
+        auto pairs = std::vector<Pair>(pairCount);
+        for (std::size_t i = 0; i < pairCount; ++i)
+        {
+            auto &pair = pairs[i];
+            pair._sharedMemoryName = "CopyToolScale_" + std::to_string(boost::this_process::get_id()) + "_" + prefix + "_" + std::to_string(i);
+            pair._destination = settings._workDir / (prefix + "_destination_" + std::to_string(i));
+            if (settings._crashEvery != 0 && i % settings._crashEvery == settings._crashEvery - 1)
+            {
+                // copyTool --inject_failure only throws in the shared memory relay.
+                auto crashKinds = transport == "shared_memory"
+                                      ? std::vector<CrashKind>{CrashKind::KillReader, CrashKind::KillWriter, CrashKind::Exception}
+                                      : std::vector<CrashKind>{CrashKind::KillReader, CrashKind::KillWriter};
+                pair._crashKind = crashKinds[(i / settings._crashEvery) % crashKinds.size()];
+            }
+            boost::interprocess::shared_memory_object::remove(pair._sharedMemoryName.c_str());
+            std::filesystem::remove(pair._destination);
+        }
+
+        for (auto &pair : pairs)
+        {
+            pair._start = Clock::now();
+            if (pair._crashKind == CrashKind::None)
+            {
+                pair._processes.push_back(Launch(settings, source, pair, slotSize, transport));
+                pair._processes.push_back(Launch(settings, source, pair, slotSize, transport));
+            }
+            else
+            {
+                LaunchCrashedPair(settings, source, pair, slotSize, transport);
+            }
+        }
+
+        // Both roles have started and the throttled copy needs seconds, so the kill lands in its middle.
+        // A victim that has already exited means the pair never went through the crash.
+        for (auto &pair : pairs)
+        {
+            if (IsKill(pair._crashKind) && !pair._crashMissed)
+            {
+                std::this_thread::sleep_until(pair._established + KillDelay);
+                auto &victim = pair._processes[pair._crashKind == CrashKind::KillReader ? 0 : 1];
+                if (victim.running())
+                {
+                    Kill(victim);
+                }
+                else
+                {
+                    pair._crashMissed = true;
+                }
+            }
+            pair._crashDeadline = Clock::now() + settings._crashTimeout;
+        }
+
+        // A pair with an injected crash only has to show that the surviving peer notices and exits.
+        auto deadline = Clock::now() + settings._timeout;
+        auto pending = pairCount;
+        while (pending != 0 && Clock::now() < deadline)
+        {
+            pending = 0;
+            for (auto &pair : pairs)
+            {
+                if (pair._finish || (pair._crashKind != CrashKind::None && Clock::now() >= pair._crashDeadline))
+                {
+                    continue;
+                }
+                if (std::none_of(pair._processes.begin(), pair._processes.end(), [](bp::child &process)
+                                 { return process.running(); }))
+                {
+                    pair._finish = Clock::now();
+                }
+                else
+                {
+                    ++pending;
+                }
+            }
+            std::this_thread::sleep_for(1ms);
+        }
+
+        auto latencies = std::vector<double>();
+        auto throughputs = std::vector<double>();
+        for (std::size_t i = 0; i < pairCount; ++i)
+        {
+            auto &pair = pairs[i];
+            std::string status;
+            if (!pair._finish)
+            {
+                for (auto &process : pair._processes)
+                {
+                    if (process.running())
+                    {
+                        Kill(process);
+                    }
+                }
+                status = "hung";
+            }
+            else if (pair._crashMissed)
+            {
+                status = "missed_crash";
+            }
+            else if (pair._crashKind != CrashKind::None)
+            {
+                // The survivor has to report the failed copy and must not leave a partial destination behind.
+                auto &survivor = pair._processes[pair._crashKind == CrashKind::KillWriter ? 0 : 1];
+                if (survivor.exit_code() == 0)
+                {
+                    status = "survivor_succeeded";
+                }
+                else if (std::filesystem::exists(pair._destination))
+                {
+                    status = "partial_destination";
+                }
+                else
+                {
+                    status = "survived";
+                }
+            }
+            else
+            {
+                status = EqualFiles(source, pair._destination) ? "ok" : "mismatch";
+            }
+            if (status != "ok" && status != "survived")
+            {
+                ++summary._failures;
+            }
+
+            std::cout << "  pair " << i << " crash=" << ToString(pair._crashKind) << " status=" << status;
+            if (pair._finish && pair._crashKind == CrashKind::None)
+            {
+                auto seconds = std::chrono::duration<double>(*pair._finish - pair._start).count();
+                latencies.push_back(seconds * 1000.0);
+                throughputs.push_back(static_cast<double>(fileSize) / (1024.0 * 1024.0) / seconds);
+                std::cout << " latency=" << latencies.back() << "ms throughput=" << throughputs.back() << "MB/s";
+            }
+            std::cout << std::endl;
+
+            boost::interprocess::shared_memory_object::remove(pair._sharedMemoryName.c_str());
+            std::filesystem::remove(pair._destination);
+            for (const auto &log : pair._logs)
+            {
+                std::filesystem::remove(log);
+            }
+        }
+        std::filesystem::remove(source);
+
+        std::cout << "transport=" << transport << " pairs=" << pairCount << " file_size=" << fileSize << " slot_size=" << slotSize
+                  << " completed=" << latencies.size()
+                  << " latency_p50=" << Percentile(latencies, 50) << "ms"
+                  << " latency_p99=" << Percentile(latencies, 99) << "ms"
+                  << " throughput_p50=" << Percentile(throughputs, 50) << "MB/s" << std::endl;
+    }
+
+    std::optional<Settings> ParseSettings(int argc, char **argv)
+    {
+        po::options_description options("Shared memory copy tool scale test options");
+        // clang-format off
+        options.add_options()
+        ("help", "Print this help message")
+        ("copy_tool", po::value<std::filesystem::path>()->required(), "Path to the copyTool executable")
+        ("work_dir", po::value<std::filesystem::path>()->default_value(std::filesystem::current_path()), "Directory for generated files")
+        ("pairs", po::value<std::vector<std::size_t>>()->multitoken()->default_value({1, 4, 16}, "1 4 16"), "Numbers of concurrent reader/writer pairs")
+        ("file_sizes", po::value<std::vector<std::size_t>>()->multitoken()->default_value({64 * 1024, 1024 * 1024}, "65536 1048576"), "Source file sizes in bytes")
+        ("slot_sizes", po::value<std::vector<std::size_t>>()->multitoken()->default_value({1024, 64 * 1024}, "1024 65536"), "Shared memory buffer sizes in bytes")
+        ("transports", po::value<std::vector<std::string>>()->multitoken()->default_value({"shared_memory"}, "shared_memory"), "Cross-process transports to compare: shared_memory, fd_passing")
+        ("crash_every", po::value<std::size_t>()->default_value(4), "Inject a peer crash into every n-th pair, 0 disables crashes")
+        ("timeout", po::value<std::size_t>()->default_value(30), "Seconds to wait for the pairs of one configuration")
+        ("crash_timeout", po::value<std::size_t>()->default_value(2), "Seconds to wait for the survivor of a crashed pair");
+        // clang-format on
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        if (vm.contains("help"))
+        {
+            std::cout << options;
+            return std::nullopt;
+        }
+        po::notify(vm);
+        return Settings{vm["copy_tool"].as<std::filesystem::path>(),
+                        vm["work_dir"].as<std::filesystem::path>(),
+                        vm["pairs"].as<std::vector<std::size_t>>(),
+                        vm["file_sizes"].as<std::vector<std::size_t>>(),
+                        vm["slot_sizes"].as<std::vector<std::size_t>>(),
+                        vm["transports"].as<std::vector<std::string>>(),
+                        vm["crash_every"].as<std::size_t>(),
+                        std::chrono::seconds(vm["timeout"].as<std::size_t>()),
+                        std::chrono::seconds(vm["crash_timeout"].as<std::size_t>())};
+    }
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        auto settings = ParseSettings(argc, argv);
+        if (!settings)
+        {
+            return 0;
+        }
+        auto summary = Summary{};
+        for (const auto &transport : settings->_transports)
+        {
+            for (auto pairCount : settings->_pairCounts)
+            {
+                for (auto fileSize : settings->_fileSizes)
+                {
+                    for (auto slotSize : settings->_slotSizes)
+                    {
+                        RunConfiguration(*settings, transport, pairCount, fileSize, slotSize, summary);
+                    }
+                }
+            }
+        }
+        std::cout << (summary._failures == 0 ? "Test Passed" : "Test Failed: " + std::to_string(summary._failures) + " pairs failed")
+                  << std::endl;
+        return summary._failures == 0 ? 0 : 1;
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+}